@@ -9,10 +9,24 @@
 #define PGM_ARGS_HPP
 
 ////////////////////////////////////////////////////////////////////////////////
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <initializer_list>
+#include <iosfwd>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -20,28 +34,164 @@
 namespace pgm
 {
 
+////////////////////////////////////////////////////////////////////////////////
+/*! @struct value_view
+ *  @brief option or param value returned by argval
+ *
+ *  Refers to the original argument without copying it, but converts to
+ *  std::string implicitly, so that it can be used where std::string values
+ *  were expected (eg, `std::string conf = args["--conf"].value();`).
+ */
+struct value_view : std::string_view
+{
+    using std::string_view::string_view;
+    constexpr value_view(std::string_view s) noexcept : std::string_view{s} { }
+    value_view(std::string const& s) noexcept : std::string_view{s} { }
+
+    operator std::string() const { return std::string{data(), size()}; }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/*! @struct value_cache
+ *  @brief converted values of argval, one entry per type
+ *
+ *  Entries are only added, so references returned by get() stay valid until
+ *  reset(). get() can be called from multiple threads at once: each thread
+ *  converts on its own and the first one to publish its entry wins. Copies
+ *  start out empty.
+ */
+struct value_cache
+{
+    value_cache() = default;
+    value_cache(value_cache const&) noexcept { }
+    value_cache(value_cache&& other) noexcept : head_{other.head_.exchange(nullptr)} { }
+
+    value_cache& operator=(value_cache const& other) noexcept
+    {
+        if (this != &other) reset();
+        return *this;
+    }
+    value_cache& operator=(value_cache&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            head_ = other.head_.exchange(nullptr);
+        }
+        return *this;
+    }
+
+    ~value_cache() { reset(); }
+
+    //! @brief return the cached `T`, or add one returned by `make()`
+    template<typename T, typename Fn>
+    T const& get(Fn&& make) const;
+
+    //! @brief drop all entries; must not be called concurrently with get()
+    void reset() noexcept;
+
+private:
+    struct node
+    {
+        void const* type; //!< address of tag<T>
+        node* next = nullptr;
+        virtual ~node() = default;
+    };
+
+    template<typename T>
+    struct entry : node { T val; };
+
+    template<typename T>
+    static inline char const tag = 0;
+
+    mutable std::atomic<node*> head_{nullptr};
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /*! @struct argval
  *  @brief parsed values for an option or positional parameter
+ *
+ *  Values are views into the `argv` array passed to args::parse(), which must
+ *  outlive them.
+ *
+ *  as<T>() and values_as<T>() convert values to arithmetic types, bool or
+ *  std::chrono::duration. Converted values are cached for each `T` until
+ *  the argval is reset, so references returned by values_as<T>() stay valid
+ *  across calls with other types. Values added by a later parse() without a
+ *  reset are not seen by the cache, so convert once parsing is done. All
+ *  const functions can be called from multiple threads at once, while
+ *  nothing is being parsed into the argval.
+ *  Large numbers of values can be converted in parallel (see
+ *  args::parallel()).
+ *
+ *  Values are stored using the memory resource of the parse_result.
  */
 struct argval
 {
-    auto count() const { return data_.size(); }
-    auto empty() const { return data_.empty(); }
+    using allocator_type = std::pmr::polymorphic_allocator<std::string_view>;
+
+    argval() = default;
+    explicit argval(allocator_type const& alloc) : data_{alloc}, choices_{alloc} { }
+
+    argval(argval const& other, allocator_type const& alloc) :
+        data_{other.data_, alloc}, choices_{other.choices_, alloc}, count_{other.count_}, config_{other.config_}, name_{other.name_}, par_{other.par_}, cache_{other.cache_}
+    { }
+    argval(argval&& other, allocator_type const& alloc) :
+        data_{std::move(other.data_), alloc}, choices_{std::move(other.choices_), alloc}, count_{other.count_}, config_{other.config_}, name_{other.name_}, par_{other.par_}, cache_{std::move(other.cache_)}
+    { }
+
+    argval(argval const&) = default;
+    argval(argval&&) = default;
+    argval& operator=(argval const&) = default;
+    argval& operator=(argval&&) = default;
+
+    auto count() const { return count_; }
+    auto empty() const { return !count_; }
 
     explicit operator bool() const { return !empty(); }
 
     auto& values() const { return data_; }
-    auto& value() const { return data_.at(0); }
-    auto& value(std::size_t n) const { return data_.at(n); }
+    auto value() const { return data_.at(0); }
+    auto value(std::size_t n) const { return data_.at(n); }
+
+    //! @brief value or `def` if none (including for options bound with args::store())
+    value_view value_or(std::string_view def) const { return data_.empty() ? def : value(); }
 
-    auto value_or(std::string_view def) const { return empty() ? std::string{def} : value(); }
+    template<typename T>
+    T as() const { return values_as<T>().at(0); }
+
+    template<typename T>
+    T as(std::size_t n) const { return values_as<T>().at(n); }
+
+    template<typename T>
+    T as_or(T def) const { return data_.empty() ? def : as<T>(); }
+
+    template<typename T>
+    std::vector<T> const& values_as() const;
+
+    /*! @brief position of the n-th value in the option's choices (see args::choices())
+     *
+     *  For a flag set (see args::flag_set()) returns a bitmask with bit `i`
+     *  set for the i-th flag. An empty value of an option marked as
+     *  pgm::optval returns -1 (or 0 for a flag set).
+     */
+    template<typename E = std::size_t>
+    E choice(std::size_t n = 0) const { return static_cast<E>(choices_.at(n)); }
 
 private:
-    std::vector<std::string> data_;
+    std::pmr::vector<value_view> data_;
+    std::pmr::vector<std::uint64_t> choices_; //!< positions or bitmasks of the values
+    std::size_t count_ = 0; //!< # of values, including ones not stored (see args::store())
+    unsigned config_ = 0;   //!< values came from n-th config file (0 = none)
+    std::string_view name_; //!< option or param name for error messages
+    std::size_t par_ = 0;   //!< convert in parallel from this many values (0 = never)
+    value_cache cache_;     //!< converted values
 
-    friend class args;
-    void add(std::string val) { data_.push_back(std::move(val)); }
+    friend struct args;
+    friend struct parse_result;
+    void add(std::string_view val) { data_.push_back(val); ++count_; }
+    void seen() { ++count_; }
+    void clear() { data_.clear(); choices_.clear(); count_ = 0; config_ = 0; cache_.reset(); } // keeps capacity
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -54,13 +204,33 @@ enum spec
     mul    = 2, //!< option/param can be specified multiple times
     optval = 4, //!< option value is optional
     opt    = 8, //!< optional param
+    stop   = 16,//!< terminal option (eg, --help); parsing stops once it's seen
 };
 
 constexpr auto operator|(spec lhs, spec rhs);
 
+////////////////////////////////////////////////////////////////////////////////
+/*! @enum response
+ *  @brief response file (@path) format
+ */
+enum class response
+{
+    none,   //!< don't expand response files
+    lines,  //!< one argument per line (or NUL-terminated)
+    shell,  //!< whitespace-separated arguments with shell-style quoting
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/*! @enum shell
+ *  @brief shell for args::completion_script()
+ */
+enum class shell { bash, zsh };
+
 ////////////////////////////////////////////////////////////////////////////////
 /*! @struct option
- *  @brief program option
+ *  @brief program option definition
+ *
+ *  Only used to define options; args stores them in its own compact form.
  */
 struct option
 {
@@ -72,8 +242,7 @@ struct option
     bool req_ = false;        //!< mandatory (required) option
     bool mul_ = false;        //!< can be specified multiple times
     bool optval_ = false;     //!< option value is optional
-
-    argval values_;           //!< parsed value(s)
+    bool stop_ = false;       //!< terminal option
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -88,7 +257,8 @@ struct param
     bool opt_ = false;        //!< optional param
     bool mul_ = false;        //!< can be specified multiple times
 
-    argval values_;           //!< parsed value(s)
+    std::function<void(std::string_view)> stream_; //!< receives values instead of argval
+    std::size_t par_ = 0;     //!< convert values in parallel from this many (see args::parallel())
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -117,10 +287,311 @@ struct arg
     auto& to_option() { return std::get<option>(val_); }
     auto& to_param() { return std::get<param>(val_); }
 
+    auto& to_option() const { return std::get<option>(val_); }
+    auto& to_param() const { return std::get<param>(val_); }
+
 private:
     std::variant<option, param> val_;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+/*! @struct static_arg
+ *  @brief compile-time program argument (either option or param)
+ *
+ *  Takes the same arguments as arg, but only refers to them.
+ */
+struct static_arg
+{
+    constexpr static_arg(std::string_view name1, std::string_view description) :
+        static_arg{name1, spec{}, description}
+    { }
+    constexpr static_arg(std::string_view name1, std::string_view name2, std::string_view description) :
+        static_arg{name1, name2, spec{}, description}
+    { }
+    constexpr static_arg(std::string_view name1, std::string_view name2, std::string_view name3, std::string_view description) :
+        static_arg{name1, name2, name3, spec{}, description}
+    { }
+
+    constexpr static_arg(std::string_view name1, spec, std::string_view description);
+    constexpr static_arg(std::string_view name1, std::string_view name2, spec, std::string_view description);
+    constexpr static_arg(std::string_view name1, std::string_view name2, std::string_view name3, spec, std::string_view description);
+
+    constexpr auto is_option() const { return !param_; }
+    constexpr auto is_param() const { return param_; }
+
+private:
+    std::string_view short_, long_, valname_; //!< option names
+    std::string_view name_;                   //!< param name
+    spec spec_{ };
+    std::string_view description_;
+    bool param_ = false;
+
+    template<std::size_t> friend struct static_args;
+    friend struct args;
+};
+
+template<std::size_t N> struct static_args;
+struct args;
+
+////////////////////////////////////////////////////////////////////////////////
+/*! @struct argid
+ *  @brief handle to an option or positional param returned by args::add()
+ */
+struct argid
+{
+    argid() = default;
+
+    friend bool operator==(argid lhs, argid rhs) { return lhs.param_ == rhs.param_ && lhs.pos_ == rhs.pos_; }
+    friend bool operator!=(argid lhs, argid rhs) { return !(lhs == rhs); }
+
+private:
+    bool param_ = false;
+    std::size_t pos_ = 0;
+
+    friend struct args;
+    friend struct parse_result;
+    argid(bool param, std::size_t pos) : param_{param}, pos_{pos} { }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/*! @struct parse_stats
+ *  @brief statistics collected by args::parse() when PGM_ARGS_STATS is defined
+ *
+ *  PGM_ARGS_STATS has to be defined before args.hpp is included, and in all
+ *  translation units alike. Otherwise nothing is collected, and there is no
+ *  parse_result::stats().
+ *
+ *  Allocations are not counted here, since they all come from the memory
+ *  resource of the parse_result, which can count them itself.
+ */
+struct parse_stats
+{
+    std::size_t tokens = 0;       //!< command line tokens (including ones from response files)
+    std::size_t options = 0;      //!< options matched (including environment and config files)
+    std::size_t params = 0;       //!< param values saved
+    std::size_t short_groups = 0; //!< short option groups expanded (eg, -abc)
+    std::size_t values = 0;       //!< option values stored or passed to store() and stream()
+    std::size_t bytes = 0;        //!< bytes copied (unquoted words and files that couldn't be mapped)
+
+    using duration = std::chrono::steady_clock::duration;
+    duration tokenize{ }; //!< splitting command line strings and response files
+    duration match{ };    //!< matching options and storing their values
+    duration check{ };    //!< checking required options
+    duration assign{ };   //!< assigning values to params
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/*! @struct parse_result
+ *  @brief option and param values parsed by args::parse()
+ *
+ *  Refers to the args it was parsed with, which must outlive it. Copies
+ *  re-point values kept in the result's own storage (eg, unquoted words) to
+ *  their own copy of it.
+ *
+ *  All values and storage used during parse() (except for the converted
+ *  values cached by argval) are allocated from the memory resource `mr`.
+ *  Eg, with std::pmr::monotonic_buffer_resource they can be released at
+ *  once.
+ */
+struct parse_result
+{
+    parse_result() = default;
+    explicit parse_result(std::pmr::memory_resource* mr) :
+        options_{mr}, params_{mr}, owned_{mr}, files_{mr}, pending_{mr}
+    { }
+
+    parse_result(parse_result const&);
+    parse_result(parse_result&&) = default; // storage changes hands as is
+    parse_result& operator=(parse_result const&);
+    parse_result& operator=(parse_result&&);
+
+    argval const& operator[](std::string_view) const;
+    argval const& operator[](argid id) const
+    {
+        return id.param_ ? params_[id.pos_] : options_[id.pos_];
+    }
+
+    //! @brief terminal option (see pgm::stop) that ended parsing, if any
+    std::optional<argid> stopped() const
+    {
+        if (stop_ == npos) return std::nullopt;
+        return argid{false, stop_};
+    }
+
+    //! @brief name of the subcommand (see args::add_command()), or empty if none
+    std::string_view command() const { return command_; }
+
+    //! @brief options and params of the subcommand
+    args const& command_args() const;
+
+    //! @brief clear all values, but keep allocated storage for reuse
+    void reset();
+
+#if defined(PGM_ARGS_STATS)
+    //! @brief statistics of parse() calls since the last reset()
+    auto& stats() const { return stats_; }
+#endif
+
+private:
+    static constexpr auto npos = static_cast<std::size_t>(-1);
+
+    args const* args_ = nullptr;
+    unsigned version_ = 0;    //!< of the definitions in args_ (see args::bind())
+    std::size_t stop_ = npos; //!< terminal option position
+
+    std::string_view command_;
+    std::shared_ptr<args> cmd_; //!< created by the subcommand factory
+    std::size_t cmd_pos_ = npos;
+
+    unsigned configs_ = 0; //!< # of config files read
+
+    std::pmr::vector<argval> options_;
+    std::pmr::vector<argval> params_;
+
+    std::pmr::deque<std::pmr::string> owned_; //!< storage for rewritten tokens
+    std::pmr::vector<std::shared_ptr<void>> files_; //!< memory-mapped response files
+
+    //! config file value of an option bound with args::store(), held until
+    //! the command line and environment had a chance to override it
+    struct pending
+    {
+        std::size_t n;         //!< option position
+        std::string_view value;
+        std::size_t line;
+        unsigned config;       //!< from n-th config file
+        std::string_view path; //!< copy of the config file path in owned_
+    };
+    std::pmr::vector<pending> pending_;
+    bool parsed_ = false; //!< config files read after parse() send values right away
+
+    auto resource() const { return owned_.get_allocator().resource(); }
+
+#if defined(PGM_ARGS_STATS)
+    parse_stats stats_;
+#endif
+
+    //! old owned_ strings and where their copies are, sorted by old address
+    using relocs = std::vector<std::pair<std::string_view, char const*>>;
+
+    template<typename R>
+    void assign(R&& other); //!< member-wise copy or move
+    relocs relocations(std::vector<std::string_view> const& from) const;
+    void rebase(relocs const&);
+
+    friend struct args;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! @brief kind of error reported by args::try_parse()
+enum class parse_errc
+{
+    none,
+    unrecognized_option,  //!< eg, -x or --foo is not defined
+    ambiguous_option,     //!< abbreviated option matches several (see args::abbreviations())
+    unexpected_value,     //!< --opt=value for an option that doesn't take values
+    missing_value,        //!< option requires a value
+    duplicate_option,     //!< option without pgm::mul repeated
+    missing_option,       //!< required option not specified
+    missing_param,        //!< required param not specified
+    extra_param,          //!< more params than defined
+    bad_value,            //!< value can't be converted (see args::store())
+    out_of_range,         //!< value is out of range (see args::store())
+    unrecognized_command, //!< subcommand is not defined
+    missing_command,      //!< subcommand not specified
+    unterminated_quote,   //!< quoted word in a command line or response file
+    bad_response_file,    //!< response file can't be read
+    nested_response_file, //!< response files nested too deeply
+    bad_config_file,      //!< config file can't be read
+    bad_config_line,      //!< line in a config file is not "key [= value]"
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/*! @struct parse_error
+ *  @brief error reported by args::try_parse()
+ *
+ *  Holds only views into the parsed tokens and the args it was parsed with
+ *  (and the config file path), all of which must outlive it. The message is
+ *  formatted on request.
+ */
+struct parse_error
+{
+    static constexpr auto npos = static_cast<std::size_t>(-1);
+
+    parse_errc kind = parse_errc::none;
+    std::size_t token = npos; //!< index of the offending token (response file contents included) or config file line
+    std::size_t slot = npos;  //!< position of the offending option or param, if known
+    std::string_view text;    //!< offending name or token; short options are just the char (eg, "x")
+    bool short_name = false;  //!< text is a short option char
+
+    explicit operator bool() const noexcept { return kind != parse_errc::none; }
+
+    //! @brief same text as what() of the exception thrown by raise()
+    std::string message() const;
+
+    //! @brief throw the exception which args::parse() would have thrown
+    [[noreturn]] void raise() const;
+
+    parse_error() = default;
+
+private:
+    args const* args_ = nullptr;
+    std::string_view config_; //!< config file the error came from, if any
+
+    std::string why() const;
+    std::string where() const; //!< location in the config file, if any
+    bool is_missing() const;
+
+    friend struct args;
+    parse_error(args const* a, parse_errc kind, std::size_t token, std::size_t slot, std::string_view text) :
+        kind{kind}, token{token}, slot{slot}, text{text}, args_{a}
+    { }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/*! @struct argv_buffer
+ *  @brief command line built by args::to_argv()
+ *
+ *  All arguments are NUL-terminated strings in one buffer, and argv() is a
+ *  null-terminated table of pointers into it, which can be passed to
+ *  execve() or posix_spawn() as is (and as many times as needed).
+ */
+struct argv_buffer
+{
+    argv_buffer() = default;
+
+    argv_buffer(argv_buffer const& other) : buf_{other.buf_} { rebase(other); }
+    argv_buffer(argv_buffer&&) = default;
+
+    argv_buffer& operator=(argv_buffer const& other)
+    {
+        if (this != &other)
+        {
+            buf_ = other.buf_;
+            rebase(other);
+        }
+        return *this;
+    }
+    argv_buffer& operator=(argv_buffer&&) = default;
+
+    int argc() const { return ptrs_.empty() ? 0 : static_cast<int>(ptrs_.size() - 1); }
+    char* const* argv() const { return ptrs_.data(); }
+
+    auto size() const { return static_cast<std::size_t>(argc()); }
+    std::string_view operator[](std::size_t n) const { return ptrs_.at(n); }
+
+private:
+    std::vector<char> buf_;
+    std::vector<char*> ptrs_; //!< into buf_, followed by nullptr
+
+    void rebase(argv_buffer const& other)
+    {
+        ptrs_.clear();
+        for (auto p : other.ptrs_) ptrs_.push_back(p ? buf_.data() + (p - other.buf_.data()) : nullptr);
+    }
+
+    friend struct args;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /*! @struct args
  *  @brief program arguments
@@ -128,29 +599,525 @@ private:
 struct args
 {
     args() = default;
-    explicit args(std::initializer_list<arg> il)
+    explicit args(std::initializer_list<arg> il) { add(il); }
+
+    //! @brief values parsed by parse(argc, argv) are allocated from `mr`
+    explicit args(std::pmr::memory_resource* mr) : result_{mr} { }
+    args(std::initializer_list<arg> il, std::pmr::memory_resource* mr) : args{mr} { add(il); }
+
+    template<std::size_t N>
+    explicit args(static_args<N> const&);
+
+    //! @brief copies and moves re-bind parsed values to the new instance
+    args(args const&);
+    args(args&&);
+    args& operator=(args const&);
+    args& operator=(args&&);
+
+    argid add(arg);
+
+    template<typename... Ts, typename = std::enable_if_t<std::is_constructible_v<arg, Ts&&...>>>
+    argid add(Ts&&... vs) { return add(arg{ std::forward<Ts>(vs)... }); }
+
+    /*! @brief add a range of args (eg, std::vector<pgm::arg>) at once
+     *
+     *  Storage is sized up front, and all names are checked for duplicates
+     *  in one pass before any of them is added. On error, args is left
+     *  unchanged and the exception names the offending option or param.
+     */
+    template<typename Range, typename = decltype(static_cast<arg const&>(*std::begin(std::declval<Range const&>())))>
+    void add(Range const&);
+
+    //! @brief reserve storage for `options` and `params` more definitions
+    void reserve(std::size_t options, std::size_t params = 0);
+
+    argval const& operator[](std::string_view name) const { return result_[find(name)]; }
+    argval const& operator[](argid id) const { return result_[id]; }
+
+    //! @brief terminal option that ended parse(argc, argv), if any
+    auto stopped() const { return result_.stopped(); }
+
+#if defined(PGM_ARGS_STATS)
+    auto& stats() const { return result_.stats(); }
+#endif
+
+    /*! @brief add subcommand `name`, whose options and params are created by `fn`
+     *
+     *  `fn` is only called when the subcommand is invoked. Options before the
+     *  subcommand name are parsed by this args, and everything after it by
+     *  the args returned from `fn`. Cannot be combined with params.
+     */
+    void add_command(std::string name, std::string description, std::function<args()> fn);
+
+    //! @brief subcommand invoked during parse(argc, argv), or empty if none
+    std::string_view command() const { return result_.command(); }
+    args const& command_args() const { return result_.command_args(); }
+
+    //! @brief accept unambiguous abbreviations of long options (eg, --recur for --recursive)
+    void abbreviations(bool on = true) { abbrev_ = on; }
+
+    /*! @struct names
+     *  @brief range of long option names returned by complete()
+     *
+     *  Refers to the args, which must outlive it.
+     */
+    struct names
+    {
+        struct iterator
+        {
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::string_view;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = std::string_view;
+
+            std::string_view operator*() const { return args_->view(args_->options_[*pos_].long_); }
+
+            auto& operator++() { ++pos_; return *this; }
+            auto operator++(int) { auto it = *this; ++pos_; return it; }
+
+            bool operator==(iterator const& rhs) const { return pos_ == rhs.pos_; }
+            bool operator!=(iterator const& rhs) const { return pos_ != rhs.pos_; }
+
+            std::uint32_t const* pos_;
+            args const* args_;
+        };
+
+        auto begin() const { return first_; }
+        auto end() const { return last_; }
+
+        auto size() const { return static_cast<std::size_t>(last_.pos_ - first_.pos_); }
+        auto empty() const { return first_ == last_; }
+
+    private:
+        iterator first_, last_;
+
+        friend struct args;
+        names(iterator first, iterator last) : first_{first}, last_{last} { }
+    };
+
+    //! @brief long option names starting with `prefix` (eg, "--re"), in sorted order
+    names complete(std::string_view prefix) const;
+
+    /*! @brief answer completion query `program --complete [word]... <current>`
+     *
+     *  Returns false if `argv` is not a completion query. Otherwise, writes
+     *  candidates for the current (last) word to `os`, one per line, and
+     *  returns true. Nothing is written when the word is an option value or
+     *  a param, so that the shell can complete file names. Values are not
+     *  checked, and only the args of the invoked subcommand are created.
+     *
+     *  Call it before parse(), eg:
+     *  @code
+     *  if (args.complete(argc, argv, std::cout)) return 0;
+     *  @endcode
+     */
+    bool complete(int argc, char* argv[], std::ostream& os) const;
+
+    /*! @brief write a completion script for `program`
+     *
+     *  Options are listed in the script itself; with subcommands the script
+     *  queries the program via complete().
+     */
+    void completion_script(std::ostream& os, std::string_view program, shell = shell::bash) const;
+
+    /*! @brief serialize values parsed by parse(argc, argv) into a new command line
+     *
+     *  Options come first in their canonical form (eg, --opt-name=value,
+     *  or -o value for options without long names), followed by params and
+     *  the subcommand with its args. Only options and params for which
+     *  `filter(name)` returns true are included, where `name` is as seen in
+     *  argval (long option name, if any). Values passed to store() or
+     *  stream() are not included, except for counted flags.
+     *
+     *  The third form reuses storage of `out`, and the last one serializes
+     *  `res` parsed by parse(..., res) with these args.
+     */
+    argv_buffer to_argv(std::string_view program) const { return to_argv(program, [](std::string_view){ return true; }); }
+
+    template<typename Filter>
+    argv_buffer to_argv(std::string_view program, Filter filter) const
     {
-        for (auto&& el : il) add(std::move(el));
+        argv_buffer out;
+        to_argv(out, program, std::move(filter));
+        return out;
     }
 
-    void add(arg);
+    template<typename Filter>
+    void to_argv(argv_buffer& out, std::string_view program, Filter filter) const { to_argv(out, result_, program, std::move(filter)); }
 
-    template<typename... Ts>
-    void add(Ts&&... vs) { add(arg{ std::forward<Ts>(vs)... }); }
+    template<typename Filter>
+    void to_argv(argv_buffer& out, parse_result const& res, std::string_view program, Filter filter) const;
 
-    argval const& operator[](std::string_view) const;
+    //! @brief expand `@path` arguments from response files in `fmt` format
+    void response_files(response fmt, std::size_t max_depth = 8)
+    {
+        rsp_ = fmt;
+        rsp_depth_ = max_depth;
+    }
+
+    /*! @brief pass values of option or multi-value param `name` to `fn` during parse()
+     *
+     *  Each value is passed along as soon as it's known to belong to `name`,
+     *  and is not stored in argval. parse() may still throw afterwards.
+     */
+    void stream(std::string_view name, std::function<void(std::string_view)> fn);
+
+    /*! @brief convert values of option or multi-value param `name` in parallel
+     *
+     *  Once there are at least `threshold` values, values_as<T>() splits them
+     *  into chunks and converts each one in its own thread. If any value is
+     *  invalid, the one with the lowest index is reported, same as when
+     *  converting one by one. Values of type bool are always converted one
+     *  by one.
+     */
+    void parallel(std::string_view name, std::size_t threshold = 16384);
+
+    /*! @brief take the value of option `name` from environment variable `var`
+     *
+     *  The variable is only used when the option is not on the command line.
+     *  For options that don't take values, the variable should be set to
+     *  1, true, yes or on. All variables are resolved in one pass over the
+     *  environment during parse(), and values are views into it.
+     */
+    void env(std::string_view name, std::string var);
+
+    /*! @brief bind every long option to an environment variable named `prefix`
+     *  followed by the option name in upper case (eg, --dry-run -> APP_DRY_RUN)
+     *
+     *  Applies to options added before and after; those bound with env() keep
+     *  their own variable.
+     */
+    void env_prefix(std::string prefix);
+
+    /*! @brief convert values of option `name` into `*dest` during parse()
+     *
+     *  `T` can be any type supported by argval::as<T>(), std::string,
+     *  std::string_view or std::vector of those; vector values are appended.
+     *  An integral `T` (other than bool) bound to an option that doesn't take
+     *  values counts its occurrences. Values are not stored in argval, but
+     *  count() and operator bool() still work.
+     *
+     *  `*dest` is shared by all parse() calls and must outlive them.
+     */
+    template<typename T>
+    void store(std::string_view name, T* dest);
+
+    /*! @brief only accept values of option `name` from `set`
+     *
+     *  The position of each value in `set` can be read with argval::choice().
+     *  Other values are reported as pgm::parse_errc::bad_value.
+     */
+    void choices(std::string_view name, std::initializer_list<std::string_view> set);
+
+    /*! @brief accept comma-separated values of option `name` from `set` (eg, --info=copy,del)
+     *
+     *  The values are combined into a bitmask, which can be read with
+     *  argval::choice(). There can be at most 64 values in `set`.
+     */
+    void flag_set(std::string_view name, std::initializer_list<std::string_view> set);
+
+    /*! @brief split values of option `name` into lists separated by `sep` (eg, --ids=1,2,3)
+     *
+     *  Each element is stored as a separate value (view into the original
+     *  one), so values(), values_as<T>(), count(), store() and choices()
+     *  all apply to the elements.
+     */
+    void separator(std::string_view name, char sep);
+
+    void parse(int argc, char* argv[]) { parse(argc, argv, result_); }
+
+    //! @brief clear values stored by parse(argc, argv), so it can be called again
+    void reset() { result_.reset(); }
+
+    /*! @brief parse the command line into `res`
+     *
+     *  Doesn't modify args, and can be called concurrently from multiple
+     *  threads (each with its own `res`).
+     */
+    void parse(int argc, char* argv[], parse_result& res) const;
+
+    /*! @brief parse arguments (without the program name) in `cmdline`
+     *
+     *  Arguments are separated by whitespace, and can be quoted or escaped
+     *  as in POSIX shell. Values are views into `cmdline`, except the quoted
+     *  and escaped ones.
+     */
+    void parse(std::string_view cmdline) { parse(cmdline, result_); }
+    void parse(std::string_view cmdline, parse_result& res) const;
+
+    //! @brief parse arguments (without the program name) in [first, last)
+    template<typename It>
+    void parse(It first, It last) { parse(first, last, result_); }
+
+    template<typename It>
+    void parse(It first, It last, parse_result& res) const
+    {
+        if (auto err = try_parse(first, last, res)) err.raise();
+    }
+
+    /*! @brief same as parse(), but report malformed arguments by returning an error
+     *
+     *  Errors thrown by multi-value param callbacks (see stream()) and
+     *  std::bad_alloc are still propagated.
+     */
+    parse_error try_parse(int argc, char* argv[]) { return try_parse(argc, argv, result_); }
+    parse_error try_parse(int argc, char* argv[], parse_result& res) const;
+
+    parse_error try_parse(std::string_view cmdline) { return try_parse(cmdline, result_); }
+    parse_error try_parse(std::string_view cmdline, parse_result& res) const;
+
+    template<typename It>
+    parse_error try_parse(It first, It last) { return try_parse(first, last, result_); }
+
+    template<typename It>
+    parse_error try_parse(It first, It last, parse_result& res) const
+    {
+        std::pmr::deque<std::string_view> args(first, last, res.resource());
+        return try_parse(args, res);
+    }
+
+    /*! @brief read option values from config file `path`
+     *
+     *  Each line has the form `key = value`, where `key` is a long option
+     *  name without the leading "--". Options that don't take values can be
+     *  given as just `key`, or with a true/false value. Blank lines and lines
+     *  starting with `#` or `;` are ignored.
+     *
+     *  The file is memory-mapped and values are views into it. Values given
+     *  on the command line or in the environment take precedence, so this
+     *  should be called before parse(). Values from a later config file
+     *  replace those from an earlier one.
+     */
+    void parse_config(std::string_view path) { parse_config(path, result_); }
+    void parse_config(std::string_view path, parse_result& res) const;
+
+    parse_error try_parse_config(std::string_view path) { return try_parse_config(path, result_); }
+    parse_error try_parse_config(std::string_view path, parse_result& res) const;
 
-    void parse(int argc, char* argv[]);
     std::string usage(std::string_view program,
         std::string_view preamble = {}, std::string_view prologue = {}, std::string_view epilogue = {}
     ) const;
 
+    //! @brief write usage directly to `os` (without the trailing newline)
+    void usage(std::ostream& os, std::string_view program,
+        std::string_view preamble = {}, std::string_view prologue = {}, std::string_view epilogue = {}
+    ) const;
+
 private:
-    std::vector<option> options_;
+    //! position and size of a string in pool_
+    struct str
+    {
+        std::uint32_t pos = 0;
+        std::uint32_t size = 0;
+    };
+
+    /*! @brief option strings (names, value names, descriptions, usage cells, etc)
+     *
+     *  Kept in one buffer, so that definitions don't allocate one by one.
+     */
+    std::string pool_;
+
+    str intern(std::string_view);
+    std::string_view view(str s) const { return {pool_.data() + s.pos, s.size}; }
+
+    /*! @struct key
+     *  @brief option data used while matching and parsing
+     */
+    struct key
+    {
+        enum : std::uint8_t { has_value = 32, has_store = 64 }; //!< in addition to spec bits
+
+        str short_, long_;          //!< option names
+        std::uint32_t choices_ = 0; //!< position of the allowed values + 1 (0 = any value)
+        std::uint8_t spec_ = 0;     //!< pgm::spec bits, has_value and has_store
+        char sep_ = 0;              //!< list separator (0 = not a list)
+
+        bool req() const { return spec_ & pgm::req; }
+        bool mul() const { return spec_ & pgm::mul; }
+        bool optval() const { return spec_ & pgm::optval; }
+        bool stop() const { return spec_ & pgm::stop; }
+        bool value() const { return spec_ & has_value; } //!< takes values
+        bool store() const { return spec_ & has_store; } //!< see details::store_
+    };
+
+    /*! @struct details
+     *  @brief option data rarely used while parsing
+     */
+    struct details
+    {
+        str valname_, description_;
+        str env_; //!< environment variable with the default value
+        str cell_; //!< usage cell (eg, "-o, --opt-name=<val>")
+        std::size_t par_ = 0; //!< convert values in parallel from this many (see args::parallel())
+        std::function<std::errc(std::string_view)> store_; //!< receives values instead of argval
+    };
+
+    std::vector<key> options_;      //!< hot, so it's dense
+    std::vector<details> details_;  //!< cold
     std::vector<param> params_;
 
-    void add_option(option);
-    void add_param(param);
+    struct command_def
+    {
+        std::string name_;
+        std::string description_;
+        std::function<args()> make_;
+    };
+    std::vector<command_def> commands_;
+
+    parse_result result_; //!< values parsed by parse(argc, argv)
+
+    //! usage cell widths, kept up to date by add()
+    struct
+    {
+        std::size_t max = 0;      //!< widest option (with short name) or param cell
+        std::size_t long_max = 0; //!< widest option cell without short name
+        bool short_fill = false;  //!< long-only options are indented by "    "
+    }
+    cells_;
+
+    response rsp_ = response::none;
+    std::size_t rsp_depth_ = 0;
+
+    /*! @struct index
+     *  @brief open-addressing hash table of option or param names
+     *
+     *  Stores name hashes and positions only; the names themselves are
+     *  compared by the `pred` passed to find().
+     */
+    struct index
+    {
+        static constexpr std::size_t npos = -1;
+
+        struct entry
+        {
+            std::size_t hash = 0;
+            std::size_t pos = 0; //!< position + 1 (0 = empty entry)
+        };
+
+        index() = default;
+
+        template<std::size_t M>
+        index(std::array<entry, M> const& table, std::size_t size, std::size_t seed) :
+            table_(table.begin(), table.end()), size_{size}, seed_{seed}
+        { }
+
+        template<typename Pred>
+        std::size_t find(std::string_view name, Pred&& pred) const;
+        void insert(std::string_view name, std::size_t pos);
+        void reserve(std::size_t size); //!< make room for `size` names without rehashing
+
+        //! @brief place `pos` into `table` of `size` and return # of extra probes
+        static constexpr std::size_t place(entry* table, std::size_t size, std::size_t hash, std::size_t pos);
+
+    private:
+        std::vector<entry> table_;
+        std::size_t size_ = 0;
+        std::size_t seed_ = 0;
+    };
+
+    std::array<std::uint32_t, 128> shorts_{ }; //!< short option char -> position + 1
+    index options_idx_;                         //!< long option names
+    std::vector<std::uint32_t> sorted_;         //!< positions of long options sorted by name
+    bool abbrev_ = false;
+    index params_idx_;
+    index commands_idx_;
+
+    struct choice_set
+    {
+        std::vector<str> names_;
+        index idx_;
+        bool mask_ = false; //!< comma-separated flags
+    };
+    std::vector<choice_set> choices_;
+
+    std::string env_prefix_;
+    index envs_idx_;           //!< environment variable names
+    std::size_t envs_n_ = 0;
+
+    unsigned version_ = 0; //!< bumped by changes that require parse results to be re-bound
+
+    argid add_option(option);
+    argid add_param(param);
+    void insert_option(option const&);
+    void insert_param(param);
+    void push_option(std::string_view short_name, std::string_view long_name, std::string_view valname, unsigned spc, std::string_view description);
+    str make_cell(key const&, std::string_view valname);
+    void add_env(std::size_t n, std::string var);
+    std::string env_var(std::string_view long_name) const; //!< --opt-name -> <prefix>OPT_NAME
+    std::size_t find_env(std::string_view var) const;
+    void add_choices(std::string_view name, std::initializer_list<std::string_view> set, bool mask);
+    bool find_choice(choice_set const&, std::string_view value, std::uint64_t& choice) const;
+
+    template<typename Fn>
+    void write_usage(Fn&&, std::string_view program, std::string_view preamble, std::string_view prologue, std::string_view epilogue) const;
+
+    std::size_t find_option(std::string_view) const;
+    std::size_t find_short(char) const;
+    std::size_t find_abbrev(std::string_view, bool& ambiguous) const;
+    void add_sorted(std::size_t first); //!< merge long options from `first` onward into sorted_
+    bool takes_next(std::string_view arg) const;
+    void complete(char** first, char** last, std::ostream&) const;
+    std::size_t find_param(std::string_view) const;
+    argid find(std::string_view) const;
+
+    template<typename R>
+    void assign(R&& other); //!< member-wise copy or move, then re-bind result_
+    void bind(parse_result&) const;
+    parse_error try_parse(std::pmr::deque<std::string_view>& args, parse_result&) const;
+    bool map_file(std::string_view path, parse_result&, char*& data, std::size_t& size) const;
+    parse_error send_pending(parse_result&) const; //!< send held config file values to store()
+    parse_errc read_file(std::string_view path, parse_result&, std::pmr::vector<std::string_view>& tokens) const;
+    parse_error add_value(std::size_t n, std::string_view value, std::size_t token, parse_result&) const;
+    parse_error add_one(std::size_t n, std::string_view value, std::size_t token, parse_result&) const;
+
+    //! @brief write args in `res` piece by piece, calling `end()` after each one
+    template<typename Filter, typename Put, typename End>
+    void serialize(parse_result const& res, Filter& filter, Put& put, End& end) const;
+
+    template<std::size_t> friend struct static_args;
+    friend struct parse_result;
+    friend struct parse_error;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/*! @struct static_args
+ *  @brief compile-time definition of program arguments
+ *
+ *  When declared constexpr, all names are validated and checked for duplicates
+ *  at compile time. The name index used by args is also pre-computed, using a
+ *  hash seed that (if possible) gives every name its own slot.
+ */
+template<std::size_t N>
+struct static_args
+{
+    constexpr static_args(static_arg const (&il)[N]) :
+        static_args{il, std::make_index_sequence<N>{}}
+    { }
+
+private:
+    static constexpr std::size_t size = [] {
+        std::size_t n = 16;
+        while (n < 4 * N) n *= 2;
+        return n;
+    }(); //!< index table size
+    static constexpr std::size_t max_seeds = 64;
+
+    using table = std::array<args::index::entry, size>;
+
+    std::array<static_arg, N> args_;
+
+    std::array<std::uint32_t, 128> shorts_{ };
+    table options_idx_{ }, params_idx_{ };
+    std::size_t options_n_ = 0, params_n_ = 0; //!< # of entries in each table
+    std::size_t seed_ = 0;
+
+    template<std::size_t... Is>
+    constexpr static_args(static_arg const (&il)[N], std::index_sequence<Is...>);
+
+    constexpr std::size_t build(std::size_t seed);
+
+    friend struct args;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
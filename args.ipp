@@ -11,11 +11,39 @@
 ////////////////////////////////////////////////////////////////////////////////
 #include <algorithm>
 #include <cctype> // std::isalnum, std::isgraph
-#include <deque>
-#include <iomanip>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring> // std::memchr
 #include <optional>
-#include <sstream>
+#include <ostream>
+#include <thread>
 #include <tuple>
+#include <type_traits>
+
+#if __has_include(<sys/mman.h>)
+#  include <cerrno>
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#else
+#  include <fstream>
+#  include <iterator>
+#endif
+
+#if defined(_WIN32)
+#  include <cstdlib> // _environ
+#else
+extern "C" char** environ; // not always declared by <unistd.h>
+#endif
+
+// compiled in only when parse_stats are collected
+#if defined(PGM_ARGS_STATS)
+#  define PGM_ARGS_STAT(...) __VA_ARGS__
+#else
+#  define PGM_ARGS_STAT(...)
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////
 namespace pgm
@@ -31,31 +59,46 @@ constexpr auto operator|(spec lhs, spec rhs)
 namespace
 {
 
+//! @brief check if `c` is an alpha-numeric character
+constexpr bool is_alnum(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+//! @brief check if `c` is a graphic character
+constexpr bool is_graph(char c) { return c > ' ' && c < '\x7f'; }
+
 //! @brief check if `s` is a valid short option
 constexpr bool is_short_option(std::string_view s)
 {
-    return s.size() == 2 && s[0] == '-' && std::isalnum(s[1]);
+    return s.size() == 2 && s[0] == '-' && is_alnum(s[1]);
 }
 
 //! @brief check if `s` is a valid long option
 constexpr bool is_long_option(std::string_view s)
 {
-    return s.size() > 2 && s[0] == '-' && s[1] == '-' && s[2] != '-'
-        && std::all_of(s.begin() + 2, s.end(), [](char c){ return c == '-' || std::isalnum(c); });
+    if (s.size() <= 2 || s[0] != '-' || s[1] != '-' || s[2] == '-') return false;
+
+    for (auto c : s.substr(2)) if (c != '-' && !is_alnum(c)) return false;
+    return true;
 }
 
 //! @brief check if `s` is a valid option value
 constexpr bool is_valname(std::string_view s)
 {
-    return s.size() > 0 && s[0] != '-'
-        && std::all_of(s.begin(), s.end(), [](char c){ return std::isgraph(c); });
+    if (s.empty() || s[0] == '-') return false;
+
+    for (auto c : s) if (!is_graph(c)) return false;
+    return true;
 }
 
 //! @brief check if `s` is a valid positional param name
 constexpr bool is_param_name(std::string_view s)
 {
-    return s.size() > 0 && s[0] != '-'
-        && std::all_of(s.begin(), s.end(), [](char c){ return std::isgraph(c); });
+    if (s.empty() || s[0] == '-') return false;
+
+    for (auto c : s) if (!is_graph(c)) return false;
+    return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -66,6 +109,7 @@ inline auto make_option(std::string short_, std::string long_, std::string valna
         static_cast<bool>(spc & req),
         static_cast<bool>(spc & mul),
         static_cast<bool>(spc & optval),
+        static_cast<bool>(spc & stop),
     };
 }
 
@@ -76,11 +120,20 @@ inline auto make_param(std::string name, spec spc, std::string description)
         std::move(name), std::move(description),
         static_cast<bool>(spc & opt),
         static_cast<bool>(spc & mul),
+        nullptr, 0,
     };
 }
 
+//! @brief FNV-1a hash of `s` with the offset basis perturbed by `seed`
+constexpr std::size_t hash(std::string_view s, std::size_t seed = 0)
+{
+    std::uint64_t h = 0xcbf29ce484222325 ^ seed;
+    for (unsigned char c : s) h = (h ^ c) * 0x100000001b3;
+    return static_cast<std::size_t>(h);
+}
+
 //! @brief return quoted `name`
-inline auto q(const std::string& name) { return "'" + name + "'"; }
+inline auto q(std::string_view name) { return "'" + std::string{name} + "'"; }
 
 }
 
@@ -138,325 +191,2305 @@ inline arg::arg(std::string name1, std::string name2, std::string name3, spec sp
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-inline void args::add(arg new_)
+namespace
 {
-    if (new_.is_option())
-        add_option(std::move(new_.to_option()));
 
-    else if (new_.is_param())
-        add_param(std::move(new_.to_param()));
+template<typename T>
+struct is_duration : std::false_type { };
 
-    else throw invalid_definition{"neither option nor param"};
+template<typename Rep, typename Period>
+struct is_duration<std::chrono::duration<Rep, Period>> : std::true_type { };
+
+//! @brief convert `s` to number `val`, optionally followed by `unit`
+template<typename T>
+std::errc to_number(std::string_view s, T& val, std::string_view* unit = nullptr)
+{
+    auto [ end, ec ] = std::from_chars(s.data(), s.data() + s.size(), val);
+    if (ec != std::errc{}) return ec;
+
+    auto rest = s.substr(end - s.data());
+    if (unit) *unit = rest;
+    else if (rest.size()) return std::errc::invalid_argument;
+
+    return std::errc{};
 }
 
-////////////////////////////////////////////////////////////////////////////////
-inline void args::add_option(option new_)
+//! @brief convert `s` to value `val` of type `T`
+template<typename T>
+std::errc convert(std::string_view s, T& val)
 {
-    if (new_.short_.size())
+    if constexpr (std::is_same_v<T, bool>)
     {
-        for (auto&& el : options_)
-            if (el.short_ == new_.short_)
-                throw invalid_definition{"duplicate option " + q(new_.short_)};
+        if (s.empty() || s == "1" || s == "true" || s == "yes" || s == "on") val = true;
+        else if (s == "0" || s == "false" || s == "no" || s == "off") val = false;
+        else return std::errc::invalid_argument;
     }
-
-    if (new_.long_.size())
+    else if constexpr (is_duration<T>::value) // eg, 10, 10ms, 2h
     {
-        for (auto&& el : options_)
-            if (el.long_ == new_.long_)
-                throw invalid_definition{"duplicate option " + q(new_.long_)};
+        using namespace std::chrono;
+        using rep = typename T::rep;
+
+        rep count{ };
+        std::string_view unit;
+        if (auto ec = to_number(s, count, &unit); ec != std::errc{}) return ec;
+
+        if (unit.empty()) val = T{count};
+        else if (unit == "ns") val = duration_cast<T>(duration<rep, std::nano>{count});
+        else if (unit == "us") val = duration_cast<T>(duration<rep, std::micro>{count});
+        else if (unit == "ms") val = duration_cast<T>(duration<rep, std::milli>{count});
+        else if (unit == "s" ) val = duration_cast<T>(duration<rep>{count});
+        else if (unit == "m" ) val = duration_cast<T>(duration<rep, std::ratio<60>>{count});
+        else if (unit == "h" ) val = duration_cast<T>(duration<rep, std::ratio<3600>>{count});
+        else return std::errc::invalid_argument;
+    }
+    else
+    {
+        static_assert(std::is_arithmetic_v<T>, "unsupported value type");
+        return to_number(s, val);
     }
+    return std::errc{};
+}
+
+//! @brief throw invalid_argument for value `val` of `name` that failed to convert with `ec`
+inline void bad_value(std::errc ec, std::string_view val, std::string_view name)
+{
+    if (ec == std::errc::result_out_of_range)
+        throw invalid_argument{"value " + q(val) + " is out of range for " + q(name)};
 
-    options_.push_back(std::move(new_));
+    else throw invalid_argument{"bad value " + q(val) + " for " + q(name)};
 }
 
-////////////////////////////////////////////////////////////////////////////////
-inline void args::add_param(param new_)
+//! @brief convert `data` in chunks, each in its own thread
+template<typename T>
+std::vector<T> convert_parallel(std::pmr::vector<value_view> const& data, std::string_view name)
 {
-    for (auto&& el : params_)
-        if (el.name_ == new_.name_)
-            throw invalid_definition{"duplicate param " + q(new_.name_)};
+    constexpr std::size_t min_chunk = 1024;
 
-    for (auto&& el : params_)
-        if (new_.mul_ && el.mul_)
-            throw invalid_argument{"more than one multi-value param " + q(new_.name_)};
+    std::size_t threads_n = std::thread::hardware_concurrency();
+    auto chunks = std::max<std::size_t>(1, std::min<std::size_t>(threads_n ? threads_n : 2, data.size() / min_chunk));
+
+    std::vector<T> vals(data.size());
+
+    // first bad value in each chunk
+    struct error { std::size_t pos = 0; std::errc ec{ }; };
+    std::vector<error> errors(chunks);
+
+    auto work = [&](std::size_t c)
+    {
+        auto first = data.size() * c / chunks, last = data.size() * (c + 1) / chunks;
+        for (auto n = first; n < last; ++n)
+            if (auto ec = convert(data[n], vals[n]); ec != std::errc{})
+            {
+                errors[c] = error{n, ec};
+                break;
+            }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(chunks - 1);
+
+    std::size_t c = 1;
+    try { for (; c < chunks; ++c) threads.emplace_back(work, c); }
+    catch (std::system_error&) { } // out of threads; do the rest here
 
-    params_.push_back(std::move(new_));
+    for (std::size_t n = c; n < chunks; ++n) work(n);
+    work(0);
+    for (auto&& th : threads) th.join();
+
+    // chunks are in order, so this is the lowest index
+    for (auto&& el : errors) if (el.ec != std::errc{}) bad_value(el.ec, data[el.pos], name);
+
+    return vals;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-inline argval const& args::operator[](std::string_view name) const
+template<typename T>
+struct is_vector : std::false_type { };
+
+template<typename T, typename A>
+struct is_vector<std::vector<T, A>> : std::true_type { };
+
+//! @brief convert `s` and store (or append) it into `dest`
+template<typename T>
+std::errc store_value(std::string_view s, T& dest)
 {
-    if (!name.empty())
-    {
-        for (auto&& el : options_)
-            if (el.short_ == name || el.long_ == name) return el.values_;
+    if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+        dest = T{s};
 
-        for (auto&& el : params_) if (el.name_ == name) return el.values_;
+    else if constexpr (is_vector<T>::value)
+    {
+        typename T::value_type val{ };
+        if (auto ec = store_value(s, val); ec != std::errc{}) return ec;
+        dest.push_back(std::move(val));
     }
-    throw invalid_argument{"unrecognized option or param " + q(std::string{name})};
+    else return convert(s, dest);
+
+    return std::errc{};
+}
+
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-namespace
+template<typename T, typename Fn>
+T const& value_cache::get(Fn&& make) const
 {
+    auto find = [](node* n) -> T const*
+    {
+        for (; n; n = n->next) if (n->type == &tag<T>) return &static_cast<entry<T>*>(n)->val;
+        return nullptr;
+    };
+
+    auto head = head_.load(std::memory_order_acquire);
+    if (auto val = find(head)) return *val;
+
+    auto n = std::make_unique<entry<T>>();
+    n->val = make();
+    n->type = &tag<T>;
+    n->next = head;
+
+    // publish, unless another thread got there first
+    while (!head_.compare_exchange_weak(n->next, n.get(), std::memory_order_release, std::memory_order_acquire))
+        if (auto val = find(n->next)) return *val;
+
+    return n.release()->val;
+}
 
-inline auto pop(std::deque<std::string>& q)
+inline void value_cache::reset() noexcept
 {
-    auto el = std::move(q.front());
-    q.pop_front();
-    return el;
+    for (auto n = head_.exchange(nullptr); n; )
+    {
+        auto next = n->next;
+        delete n;
+        n = next;
+    }
 }
 
-inline bool is_not_option(std::string_view s)
+////////////////////////////////////////////////////////////////////////////////
+template<typename T>
+std::vector<T> const& argval::values_as() const
 {
-    return s.empty() || s == "-" || s[0] != '-';
+    return cache_.get<std::vector<T>>([&]
+    {
+        if constexpr (!std::is_same_v<T, bool>) // std::vector<bool> can't be written concurrently
+            if (par_ && data_.size() >= par_) return convert_parallel<T>(data_, name_);
+
+        std::vector<T> vals;
+        vals.reserve(data_.size());
+
+        for (auto&& el : data_)
+        {
+            T val{ };
+            if (auto ec = convert(el, val); ec != std::errc{}) bad_value(ec, el, name_);
+
+            vals.push_back(val);
+        }
+        return vals;
+    });
 }
 
+////////////////////////////////////////////////////////////////////////////////
+constexpr static_arg::static_arg(std::string_view name1, spec spc, std::string_view description) :
+    spec_{spc}, description_{description}
+{
+    if (is_short_option(name1)) short_ = name1;
+
+    else if (is_long_option(name1)) long_ = name1;
+
+    else if (is_param_name(name1))
+    {
+        param_ = true;
+        name_ = name1;
+    }
+    else throw invalid_definition{"bad option or param name " + q(name1)};
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-inline void args::parse(int argc, char* argv[])
+constexpr static_arg::static_arg(std::string_view name1, std::string_view name2, spec spc, std::string_view description) :
+    spec_{spc}, description_{description}
 {
-    std::deque<std::string> args;
-    for (auto n = 1; n < argc; ++n) args.emplace_back(argv[n]);
+    if (is_short_option(name1))
+    {
+        short_ = name1;
 
-    bool had_token = false;
-    std::deque<std::string> saved;
+        if (is_long_option(name2)) long_ = name2;
 
-    while (args.size())
+        else if (is_valname(name2)) valname_ = name2;
+
+        else throw invalid_definition{"bad long option or option value name " + q(name2)};
+    }
+    else if (is_long_option(name1))
     {
-        auto arg = pop(args);
+        long_ = name1;
 
-        if (had_token || is_not_option(arg)) // param ("", "-" or re: "[^-].+")
-            saved.push_back(std::move(arg)); // process at the end
+        if (is_valname(name2)) valname_ = name2;
 
-        else if (arg == "--") // end-of-options token
-            had_token = true;
+        else throw invalid_definition{"bad option value name " + q(name2)};
+    }
+    else throw invalid_definition{"bad short or long option name " + q(name1)};
+}
 
-        else // option (re: "-.+")
-        {
-            std::string name;
-            std::optional<std::string> value;
+////////////////////////////////////////////////////////////////////////////////
+constexpr static_arg::static_arg(std::string_view name1, std::string_view name2, std::string_view name3, spec spc, std::string_view description) :
+    short_{name1}, long_{name2}, valname_{name3}, spec_{spc}, description_{description}
+{
+    if (!is_short_option(name1))
+        throw invalid_definition{"bad short option name " + q(name1)};
 
-            if (arg[1] == '-') // long option (re: "--.+")
-            {
-                auto p = arg.find('=', 2);
-                if (p != std::string::npos) // with value (re: "--[^=]+=.?")
-                {
-                    name = arg.substr(0, p);
-                    value = arg.substr(p + 1);
-                }
-                else name = arg; // without value (re: "--[^=]+")
-            }
-            else // short option (re: -[^-].?)
-            {
-                name = arg.substr(0, 2);
-                if (arg.size() > 2) value = arg.substr(2); // with value (re: "-[^-].+")
-            }
+    else if (!is_long_option(name2))
+        throw invalid_definition{"bad long option name " + q(name2)};
 
-            // find matching definition
-            auto pred = [&](auto const& el){ return el.short_ == name || el.long_ == name; };
+    else if (!is_valname(name3))
+        throw invalid_definition{"bad option value name " + q(name3)};
+}
 
-            auto it = std::find_if(options_.begin(), options_.end(), pred);
-            if (it == options_.end())
-                throw invalid_argument{"unrecognized option " + q(name)};
+////////////////////////////////////////////////////////////////////////////////
+template<std::size_t N>
+template<std::size_t... Is>
+constexpr static_args<N>::static_args(static_arg const (&il)[N], std::index_sequence<Is...>) :
+    args_{ il[Is]... }
+{
+    auto mul_n = 0;
+    for (std::size_t i = 0; i < N; ++i)
+    {
+        auto& el = args_[i];
+        if (el.param_ && (el.spec_ & mul)) ++mul_n;
 
-            else if (it->valname_.empty()) // doesn't take values
-            {
-                if (value) // but we have one
-                {
-                    if (name.size() == 2) // short option
-                    {
-                        // maybe this is a group of short options? (eg, -abc)
-                        // push them to the front of the queue
-                        args.push_front("-" + *value);
-                    }
-                    else throw invalid_argument{q(name) + " doesn't take values"};
-                }
-                value = ""; // indicate presence
-            }
-            else if (it->optval_) // optional value
+        for (std::size_t j = 0; j < i; ++j)
+        {
+            auto& prev = args_[j];
+            if (el.param_)
             {
-                if (!value) // and we don't have one
-                {
-                    // take the next arg, if it's not an option
-                    if (args.size() && is_not_option(args[0]))
-                        value = pop(args);
-                    else value = ""; // or indicate presence
-                }
+                if (prev.param_ && prev.name_ == el.name_)
+                    throw invalid_definition{"duplicate param " + q(el.name_)};
             }
-            else // requires value
+            else if (!prev.param_)
             {
-                if (!value) // but we don't have one
-                {
-                    // take the next arg unless it's "--"
-                    if (args.size() && args[0] != "--")
-                        value = pop(args);
-                    else throw missing_argument{q(name) + " requires a value"};
-                }
+                if (el.short_.size() && prev.short_ == el.short_)
+                    throw invalid_definition{"duplicate option " + q(el.short_)};
+
+                if (el.long_.size() && prev.long_ == el.long_)
+                    throw invalid_definition{"duplicate option " + q(el.long_)};
             }
+        }
 
-            if (!it->mul_ && !it->values_.empty())
-                throw invalid_argument{"duplicate option " + q(name)};
+        if (mul_n > 1) throw invalid_argument{"more than one multi-value param " + q(el.name_)};
+    }
 
-            it->values_.add(std::move(*value));
+    std::uint32_t options_pos = 0;
+    for (auto&& el : args_)
+        if (!el.param_)
+        {
+            ++options_pos;
+            if (el.short_.size()) shorts_[static_cast<unsigned char>(el.short_[1])] = options_pos;
         }
-    }
 
-    // check required options
-    for (auto&& el : options_)
-        if (el.req_ && el.values_.empty()) throw missing_argument{
-            "option " + q(el.short_.empty() ? el.long_ : el.long_.empty() ? el.short_ : el.short_+", "+el.long_) + " is required"
-        };
+    // look for a seed that places every long name and param name into its home slot
+    std::size_t best = 0, best_probes = build(0);
+    for (std::size_t seed = 1; best_probes && seed < max_seeds; ++seed)
+        if (auto probes = build(seed); probes < best_probes)
+        {
+            best = seed;
+            best_probes = probes;
+        }
 
-    // process params
-    auto req_n = std::count_if(params_.begin(), params_.end(),
-        [&](auto const& el){ return !el.opt_; }
-    ); // # of non-opt params to fill
+    build(best);
+}
 
-    for (auto it = params_.begin(), end = params_.end(); it != end; ++it)
+////////////////////////////////////////////////////////////////////////////////
+template<std::size_t N>
+constexpr std::size_t static_args<N>::build(std::size_t seed)
+{
+    options_idx_ = table{ };
+    params_idx_ = table{ };
+    options_n_ = params_n_ = 0;
+    seed_ = seed;
+
+    std::size_t probes = 0, options_pos = 0, params_pos = 0;
+    for (auto&& el : args_)
     {
-        if (!it->opt_) --req_n;
-        else if (saved.size() <= req_n) continue; // not enough for opt params
+        if (el.param_)
+        {
+            probes += args::index::place(params_idx_.data(), size, hash(el.name_, seed), params_pos++);
+            ++params_n_;
+        }
+        else
+        {
+            if (el.long_.size())
+            {
+                probes += args::index::place(options_idx_.data(), size, hash(el.long_, seed), options_pos);
+                ++options_n_;
+            }
+            ++options_pos;
+        }
+    }
+    return probes;
+}
 
-        if (saved.size())
+////////////////////////////////////////////////////////////////////////////////
+template<std::size_t N>
+inline args::args(static_args<N> const& def) :
+    shorts_{def.shorts_},
+    options_idx_{def.options_idx_, def.options_n_, def.seed_},
+    params_idx_{def.params_idx_, def.params_n_, def.seed_}
+{
+    for (auto&& el : def.args_)
+    {
+        if (el.param_)
         {
-            do it->values_.add(pop(saved));
-            while (it->mul_ && saved.size() >= end - it); // munch extra values
+            params_.push_back(make_param(
+                std::string{el.name_}, el.spec_, std::string{el.description_}
+            ));
+            cells_.max = std::max(cells_.max, el.name_.size());
         }
-        else throw missing_argument{"param " + q(it->name_) + " is required"};
+        else push_option(el.short_, el.long_, el.valname_, el.spec_, el.description_);
     }
+    add_sorted(0);
 
-    if (saved.size()) throw invalid_argument{"extra param " + q(saved[0])};
+    result_.options_.resize(options_.size());
+    result_.params_.resize(params_.size());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-inline std::string args::usage(std::string_view program, std::string_view preamble, std::string_view prologue, std::string_view epilogue) const
+inline argid args::add(arg new_)
 {
-    std::string short_fill = std::any_of(options_.begin(), options_.end(),
-        [](auto&& el){ return el.short_.size(); }
-    ) ? "    " : ""; // filler for "-o, "
-
-    std::size_t cell_0_max = 0;
-    std::vector<std::tuple<std::string, std::string>> rows;
+    if (new_.is_option())
+        return add_option(std::move(new_.to_option()));
 
-    ////////////////////
-    if (preamble.size())
-    {
-        rows.emplace_back(preamble, "");
-        rows.emplace_back("", "");
-    }
+    else if (new_.is_param())
+        return add_param(std::move(new_.to_param()));
 
-    ////////////////////
-    auto cell_0 = "Usage: " + std::string{program};
+    else throw invalid_definition{"neither option nor param"};
+}
 
-    if (options_.size()) cell_0 += " [option]...";
-    if (params_.size())
+////////////////////////////////////////////////////////////////////////////////
+template<typename Pred>
+inline std::size_t args::index::find(std::string_view name, Pred&& pred) const
+{
+    if (table_.size())
     {
-        for (auto&& el : params_)
-        {
-            if (el.opt_) cell_0 += " [" + el.name_ + "]";
-            else cell_0 += " <" + el.name_ + ">";
+        auto h = hash(name, seed_);
+        auto mask = table_.size() - 1;
 
-            if (el.mul_) cell_0 += "...";
-        }
+        for (auto n = h & mask; table_[n].pos; n = (n + 1) & mask)
+            if (table_[n].hash == h && pred(table_[n].pos - 1)) return table_[n].pos - 1;
     }
-    rows.emplace_back(std::move(cell_0), "");
+    return npos;
+}
 
-    ////////////////////
-    if (prologue.size())
+////////////////////////////////////////////////////////////////////////////////
+inline void args::index::insert(std::string_view name, std::size_t pos)
+{
+    if (2 * (size_ + 1) > table_.size()) // keep load factor at or below 1/2
     {
-        rows.emplace_back("", "");
-        rows.emplace_back(prologue, "");
+        std::vector<entry> table(std::max<std::size_t>(16, 2 * table_.size()));
+        std::swap(table_, table);
+
+        for (auto&& el : table) if (el.pos) place(table_.data(), table_.size(), el.hash, el.pos - 1);
     }
 
-    ////////////////////
-    if (options_.size())
-    {
-        rows.emplace_back("", "");
-        rows.emplace_back("Options:", "");
+    place(table_.data(), table_.size(), hash(name, seed_), pos);
+    ++size_;
+}
 
-        for (auto&& el : options_)
-        {
-            std::string cell_0;
-            if (el.short_.size())
-            {
-                cell_0 += el.short_; // "-o"
-                if (el.long_.size())
-                {
-                    cell_0 += ", " + el.long_; // "-o, --opt-name"
-                    if (el.valname_.size()) cell_0 += "="; // "-o, --opt-name="
-                }
-                else if (el.valname_.size()) cell_0 += " "; // "-o "
-            }
-            else
-            {
-                cell_0 += short_fill + el.long_; // "    --opt-name"
-                if (el.valname_.size()) cell_0 += "="; // "    --opt-name="
-            }
+inline void args::index::reserve(std::size_t size)
+{
+    if (2 * size <= table_.size()) return;
 
-            if (el.valname_.size())
-            {
-                if (el.optval_) cell_0 += "[" + el.valname_ + "]"; // "...[val]"
-                else cell_0 += "<" + el.valname_ + ">"; // "...<val>"
-            }
+    auto n = std::max<std::size_t>(16, table_.size());
+    while (n < 2 * size) n *= 2;
 
-            cell_0_max = std::max(cell_0_max, cell_0.size());
+    std::vector<entry> table(n);
+    std::swap(table_, table);
 
-            std::istringstream iss{el.description_ + "\n"};
-            std::string cell_1;
-            std::getline(iss, cell_1);
+    for (auto&& el : table) if (el.pos) place(table_.data(), table_.size(), el.hash, el.pos - 1);
+}
 
-            rows.emplace_back(std::move(cell_0), std::move(cell_1));
-            while (std::getline(iss, cell_1)) rows.emplace_back("", std::move(cell_1));
-        }
-    }
+////////////////////////////////////////////////////////////////////////////////
+constexpr std::size_t args::index::place(entry* table, std::size_t size, std::size_t hash, std::size_t pos)
+{
+    std::size_t probes = 0;
 
-    ////////////////////
-    if (params_.size())
-    {
-        rows.emplace_back("", "");
-        rows.emplace_back("Parameters:", "");
+    auto mask = size - 1;
+    auto n = hash & mask;
+    for (; table[n].pos; n = (n + 1) & mask) ++probes;
 
-        for (auto&& el : params_)
-        {
-            cell_0_max = std::max(cell_0_max, el.name_.size());
+    table[n].hash = hash;
+    table[n].pos = pos + 1;
+    return probes;
+}
 
-            std::istringstream iss{el.description_ + "\n"};
-            std::string cell_1;
-            std::getline(iss, cell_1);
+////////////////////////////////////////////////////////////////////////////////
+inline args::str args::intern(std::string_view s)
+{
+    str r{static_cast<std::uint32_t>(pool_.size()), static_cast<std::uint32_t>(s.size())};
+    pool_.append(s.data(), s.size());
+    return r;
+}
 
-            rows.emplace_back(el.name_, std::move(cell_1));
-            while (std::getline(iss, cell_1)) rows.emplace_back("", std::move(cell_1));
-        }
-    }
+////////////////////////////////////////////////////////////////////////////////
+inline argid args::add_option(option new_)
+{
+    if (new_.short_.size() && find_short(new_.short_[1]) != index::npos)
+        throw invalid_definition{"duplicate option " + q(new_.short_)};
 
-    ////////////////////
-    if (epilogue.size())
-    {
-        rows.emplace_back("", "");
-        rows.emplace_back(epilogue, "");
-    }
+    if (new_.long_.size() && find_option(new_.long_) != index::npos)
+        throw invalid_definition{"duplicate option " + q(new_.long_)};
 
-    ////////////////////
-    std::ostringstream oss;
-    oss << std::left;
+    if (env_prefix_.size() && new_.long_.size())
+        if (auto var = env_var(new_.long_); find_env(var) != index::npos)
+            throw invalid_definition{"duplicate environment variable " + q(var)};
 
-    for (auto&& [ cell_0, cell_1 ] : rows)
-    {
-        oss << std::setw(cell_0_max) << cell_0;
-        if (cell_1.size()) oss << "    " << cell_1;
-        oss << "\n";
-    }
+    auto pos = options_.size();
+    insert_option(new_);
+    add_sorted(pos);
+    ++version_; // re-bind on next parse
 
-    auto overall = oss.str();
-    overall.pop_back(); // remove trailing '\n'
+    return argid{false, pos};
+}
 
-    return overall;
+inline void args::insert_option(option const& el)
+{
+    auto pos = options_.size();
+    if (el.short_.size()) shorts_[static_cast<unsigned char>(el.short_[1])] = pos + 1;
+    if (el.long_.size()) options_idx_.insert(el.long_, pos);
+
+    push_option(el.short_, el.long_, el.valname_,
+        (el.req_ ? req : 0) | (el.mul_ ? mul : 0) | (el.optval_ ? optval : 0) | (el.stop_ ? stop : 0),
+        el.description_
+    );
+    result_.options_.emplace_back();
+
+    if (env_prefix_.size() && el.long_.size()) add_env(pos, {});
+}
+
+inline void args::push_option(std::string_view short_name, std::string_view long_name, std::string_view valname, unsigned spc, std::string_view description)
+{
+    key el;
+    el.short_ = intern(short_name);
+    el.long_ = intern(long_name);
+    el.spec_ = static_cast<std::uint8_t>(spc & (req | mul | optval | stop));
+    if (valname.size()) el.spec_ |= key::has_value;
+
+    details info;
+    info.valname_ = intern(valname);
+    info.description_ = intern(description);
+    info.cell_ = make_cell(el, valname);
+
+    options_.push_back(el);
+    details_.push_back(std::move(info));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
+inline argid args::add_param(param new_)
+{
+    if (find_param(new_.name_) != index::npos)
+        throw invalid_definition{"duplicate param " + q(new_.name_)};
+
+    if (new_.mul_ && std::any_of(params_.begin(), params_.end(), [](auto&& el){ return el.mul_; }))
+        throw invalid_argument{"more than one multi-value param " + q(new_.name_)};
+
+    if (commands_.size())
+        throw invalid_definition{"param " + q(new_.name_) + " added to args with commands"};
+
+    auto pos = params_.size();
+    insert_param(std::move(new_));
+    ++version_; // re-bind on next parse
+
+    return argid{true, pos};
+}
+
+inline void args::insert_param(param el)
+{
+    params_idx_.insert(el.name_, params_.size());
+    cells_.max = std::max(cells_.max, el.name_.size());
+
+    params_.push_back(std::move(el));
+    result_.params_.emplace_back();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+template<typename Range, typename>
+void args::add(Range const& range)
+{
+    std::size_t options_n = 0, params_n = 0;
+    for (arg const& el : range) el.is_option() ? ++options_n : ++params_n;
+
+    // check names before adding any of them
+    auto shorts = shorts_;
+    std::vector<std::string_view> longs, params;
+    longs.reserve(options_n);
+    params.reserve(params_n);
+
+    std::vector<std::string> envs; // derived from env_prefix()
+    if (env_prefix_.size()) envs.reserve(options_n);
+
+    bool has_mul = std::any_of(params_.begin(), params_.end(), [](auto&& el){ return el.mul_; });
+
+    for (arg const& el : range)
+        if (el.is_option())
+        {
+            auto& opt = el.to_option();
+            if (opt.short_.size() && shorts[static_cast<unsigned char>(opt.short_[1])]++)
+                throw invalid_definition{"duplicate option " + q(opt.short_)};
+
+            if (opt.long_.size())
+            {
+                if (find_option(opt.long_) != index::npos)
+                    throw invalid_definition{"duplicate option " + q(opt.long_)};
+                longs.push_back(opt.long_);
+
+                if (env_prefix_.size())
+                {
+                    auto& var = envs.emplace_back(env_var(opt.long_));
+                    if (find_env(var) != index::npos)
+                        throw invalid_definition{"duplicate environment variable " + q(var)};
+                }
+            }
+        }
+        else
+        {
+            auto& par = el.to_param();
+            if (find_param(par.name_) != index::npos)
+                throw invalid_definition{"duplicate param " + q(par.name_)};
+
+            if (par.mul_ && std::exchange(has_mul, true))
+                throw invalid_argument{"more than one multi-value param " + q(par.name_)};
+
+            if (commands_.size())
+                throw invalid_definition{"param " + q(par.name_) + " added to args with commands"};
+
+            params.push_back(par.name_);
+        }
+
+    // duplicates within the range
+    for (auto* names : { &longs, &params })
+    {
+        std::sort(names->begin(), names->end());
+        if (auto it = std::adjacent_find(names->begin(), names->end()); it != names->end())
+            throw invalid_definition{(names == &longs ? "duplicate option " : "duplicate param ") + q(*it)};
+    }
+
+    std::sort(envs.begin(), envs.end());
+    if (auto it = std::adjacent_find(envs.begin(), envs.end()); it != envs.end())
+        throw invalid_definition{"duplicate environment variable " + q(*it)};
+
+    ////////////////////
+    reserve(options_n, params_n);
+
+    auto first = options_.size();
+    for (arg const& el : range)
+        if (el.is_option()) insert_option(el.to_option());
+        else insert_param(el.to_param());
+
+    add_sorted(first);
+    ++version_; // re-bind on next parse
+}
+
+inline void args::reserve(std::size_t options, std::size_t params)
+{
+    options += options_.size();
+    params += params_.size();
+
+    options_.reserve(options);
+    details_.reserve(options);
+    sorted_.reserve(options);
+    options_idx_.reserve(options);
+    result_.options_.reserve(options);
+
+    params_.reserve(params);
+    params_idx_.reserve(params);
+    result_.params_.reserve(params);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline std::size_t args::find_option(std::string_view name) const
+{
+    if (name.size() == 2 && name[0] == '-' && name[1] != '-') return find_short(name[1]);
+    return options_idx_.find(name, [&](auto n){ return view(options_[n].long_) == name; });
+}
+
+inline std::size_t args::find_short(char c) const
+{
+    auto n = static_cast<unsigned char>(c);
+    return n < shorts_.size() && shorts_[n] ? shorts_[n] - 1 : index::npos;
+}
+
+inline void args::add_sorted(std::size_t first)
+{
+    auto mid = sorted_.size();
+    for (auto n = first; n < options_.size(); ++n)
+        if (options_[n].long_.size) sorted_.push_back(static_cast<std::uint32_t>(n));
+
+    auto less = [&](auto x, auto y){ return view(options_[x].long_) < view(options_[y].long_); };
+    std::sort(sorted_.begin() + mid, sorted_.end(), less);
+    std::inplace_merge(sorted_.begin(), sorted_.begin() + mid, sorted_.end(), less);
+}
+
+inline args::names args::complete(std::string_view prefix) const
+{
+    auto less = [&](auto n, auto name){ return view(options_[n].long_) < name; };
+
+    auto first = std::lower_bound(sorted_.begin(), sorted_.end(), prefix, less);
+    auto last = first;
+    while (last != sorted_.end() && view(options_[*last].long_).substr(0, prefix.size()) == prefix) ++last;
+
+    auto data = sorted_.data();
+    return names{
+        names::iterator{data + (first - sorted_.begin()), this},
+        names::iterator{data + (last - sorted_.begin()), this}
+    };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline std::size_t args::find_abbrev(std::string_view name, bool& ambiguous) const
+{
+    auto n = find_option(name);
+    if (n != index::npos || !abbrev_ || name.size() < 3) return n;
+
+    auto match = complete(name);
+    if (match.size() == 1) return *match.begin().pos_;
+
+    ambiguous = match.size() > 1;
+    return index::npos;
+}
+
+inline std::size_t args::find_param(std::string_view name) const
+{
+    return params_idx_.find(name, [&](auto n){ return params_[n].name_ == name; });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline argid args::find(std::string_view name) const
+{
+    if (!name.empty())
+    {
+        if (auto n = find_option(name); n != index::npos) return argid{false, n};
+        if (auto n = find_param(name); n != index::npos) return argid{true, n};
+    }
+    throw invalid_argument{"unrecognized option or param " + q(name)};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline argval const& parse_result::operator[](std::string_view name) const
+{
+    if (!args_) throw invalid_argument{"unrecognized option or param " + q(name)};
+    return (*this)[args_->find(name)];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline parse_result::parse_result(parse_result const& other) :
+    parse_result{other.resource()}
+{
+    *this = other;
+}
+
+inline parse_result& parse_result::operator=(parse_result const& other)
+{
+    if (this != &other)
+    {
+        assign(other);
+        rebase(relocations({ other.owned_.begin(), other.owned_.end() }));
+    }
+    return *this;
+}
+
+inline parse_result& parse_result::operator=(parse_result&& other)
+{
+    if (this != &other)
+    {
+        // with the same resource storage changes hands as is, otherwise it's copied
+        if (resource() == other.resource()) assign(std::move(other));
+        else
+        {
+            std::vector<std::string_view> from{ other.owned_.begin(), other.owned_.end() };
+            assign(std::move(other));
+            rebase(relocations(from));
+        }
+    }
+    return *this;
+}
+
+template<typename R>
+void parse_result::assign(R&& other)
+{
+    args_ = other.args_;
+    version_ = other.version_;
+    stop_ = other.stop_;
+
+    command_ = other.command_;
+    if constexpr (std::is_lvalue_reference_v<R>)
+        cmd_ = other.cmd_ ? std::allocate_shared<args>(std::pmr::polymorphic_allocator<char>{resource()}, *other.cmd_) : nullptr;
+    else cmd_ = std::move(other.cmd_);
+    cmd_pos_ = other.cmd_pos_;
+
+    configs_ = other.configs_;
+
+    options_ = std::forward<R>(other).options_;
+    params_ = std::forward<R>(other).params_;
+
+    owned_ = std::forward<R>(other).owned_;
+    files_ = std::forward<R>(other).files_;
+
+    pending_ = std::forward<R>(other).pending_;
+    parsed_ = other.parsed_;
+
+    PGM_ARGS_STAT(stats_ = other.stats_;)
+}
+
+inline parse_result::relocs parse_result::relocations(std::vector<std::string_view> const& from) const
+{
+    relocs rel;
+    rel.reserve(from.size());
+
+    auto to = owned_.begin();
+    for (auto&& el : from) rel.emplace_back(el, (to++)->data());
+
+    std::sort(rel.begin(), rel.end(), [](auto& x, auto& y){ return std::less<>{}(x.first.data(), y.first.data()); });
+    return rel;
+}
+
+inline void parse_result::rebase(relocs const& rel)
+{
+    if (rel.empty()) return;
+
+    auto move = [&](std::string_view& val)
+    {
+        auto it = std::upper_bound(rel.begin(), rel.end(), val.data(), [](auto p, auto& el){ return std::less<>{}(p, el.first.data()); });
+        if (it == rel.begin()) return;
+
+        auto& [old, data] = *--it;
+        if (std::less_equal<>{}(val.data() + val.size(), old.data() + old.size()))
+            val = { data + (val.data() - old.data()), val.size() };
+    };
+
+    for (auto* vals : { &options_, &params_ })
+        for (auto&& el : *vals)
+            for (auto&& val : el.data_) move(val);
+    move(command_);
+
+    for (auto&& el : pending_) move(el.value), move(el.path);
+
+    // subcommand values can come from our storage too
+    if (cmd_) cmd_->result_.rebase(rel);
+}
+
+inline void parse_result::reset()
+{
+    for (auto&& el : options_) el.clear();
+    for (auto&& el : params_) el.clear();
+
+    owned_.clear();
+    files_.clear();
+    pending_.clear();
+    parsed_ = false;
+    stop_ = npos;
+    configs_ = 0;
+    PGM_ARGS_STAT(stats_ = { };)
+
+    // keep the last subcommand for reuse
+    command_ = { };
+    if (cmd_) cmd_->reset();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline args::args(args const& other) : result_{other.result_.resource()} { assign(other); }
+inline args::args(args&& other) : result_{other.result_.resource()} { assign(std::move(other)); }
+
+inline args& args::operator=(args const& other)
+{
+    if (this != &other) assign(other);
+    return *this;
+}
+
+inline args& args::operator=(args&& other)
+{
+    if (this != &other) assign(std::move(other));
+    return *this;
+}
+
+template<typename R>
+void args::assign(R&& other)
+{
+    pool_ = std::forward<R>(other).pool_;
+
+    options_ = std::forward<R>(other).options_;
+    details_ = std::forward<R>(other).details_;
+    params_ = std::forward<R>(other).params_;
+    commands_ = std::forward<R>(other).commands_;
+
+    result_ = std::forward<R>(other).result_;
+
+    cells_ = other.cells_;
+    rsp_ = other.rsp_;
+    rsp_depth_ = other.rsp_depth_;
+
+    shorts_ = other.shorts_;
+    options_idx_ = std::forward<R>(other).options_idx_;
+    sorted_ = std::forward<R>(other).sorted_;
+    abbrev_ = other.abbrev_;
+    params_idx_ = std::forward<R>(other).params_idx_;
+    commands_idx_ = std::forward<R>(other).commands_idx_;
+
+    choices_ = std::forward<R>(other).choices_;
+
+    env_prefix_ = std::forward<R>(other).env_prefix_;
+    envs_idx_ = std::forward<R>(other).envs_idx_;
+    envs_n_ = other.envs_n_;
+    version_ = other.version_;
+
+    // names of parsed values point into pool_ of the original
+    if (result_.args_ == &other) bind(result_);
+    else result_.args_ = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline void args::bind(parse_result& res) const
+{
+    res.args_ = this;
+    res.version_ = version_;
+
+    res.options_.resize(options_.size());
+    for (std::size_t n = 0; n < options_.size(); ++n)
+    {
+        auto& el = options_[n];
+        res.options_[n].name_ = view(el.long_.size ? el.long_ : el.short_);
+        res.options_[n].par_ = details_[n].par_;
+    }
+
+    res.params_.resize(params_.size());
+    for (std::size_t n = 0; n < params_.size(); ++n)
+    {
+        res.params_[n].name_ = params_[n].name_;
+        res.params_[n].par_ = params_[n].par_;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline void args::stream(std::string_view name, std::function<void(std::string_view)> fn)
+{
+    if (auto n = find_option(name); n != index::npos)
+    {
+        details_[n].store_ = [fn = std::move(fn)](std::string_view val){ fn(val); return std::errc{}; };
+        options_[n].spec_ |= key::has_store;
+        return;
+    }
+
+    auto n = find_param(name);
+    if (n == index::npos)
+        throw invalid_definition{"unrecognized param " + q(name)};
+
+    else if (!params_[n].mul_)
+        throw invalid_definition{"param " + q(name) + " is not multi-value"};
+
+    params_[n].stream_ = std::move(fn);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline void args::parallel(std::string_view name, std::size_t threshold)
+{
+    if (auto n = find_option(name); n != index::npos)
+    {
+        if (!options_[n].value())
+            throw invalid_definition{"option " + q(name) + " doesn't take values"};
+
+        details_[n].par_ = threshold;
+    }
+    else
+    {
+        n = find_param(name);
+        if (n == index::npos)
+            throw invalid_definition{"unrecognized option or param " + q(name)};
+
+        else if (!params_[n].mul_)
+            throw invalid_definition{"param " + q(name) + " is not multi-value"};
+
+        params_[n].par_ = threshold;
+    }
+    ++version_; // re-bind on next parse
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline void args::env(std::string_view name, std::string var)
+{
+    auto n = find_option(name);
+    if (n == index::npos)
+        throw invalid_definition{"unrecognized option " + q(name)};
+
+    add_env(n, std::move(var));
+}
+
+inline void args::env_prefix(std::string prefix)
+{
+    env_prefix_ = std::move(prefix);
+    for (std::size_t n = 0; n < options_.size(); ++n)
+        if (!details_[n].env_.size && options_[n].long_.size) add_env(n, {});
+}
+
+inline std::string args::env_var(std::string_view long_name) const
+{
+    auto var = env_prefix_;
+    for (auto c : long_name.substr(2))
+        var += c == '-' ? '_' : ('a' <= c && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+    return var;
+}
+
+inline std::size_t args::find_env(std::string_view var) const
+{
+    return envs_idx_.find(var, [&](auto n){ return view(details_[n].env_) == var; });
+}
+
+inline void args::add_env(std::size_t n, std::string var)
+{
+    auto& el = details_[n];
+    if (var.empty()) var = env_var(view(options_[n].long_));
+
+    if (find_env(var) != index::npos)
+        throw invalid_definition{"duplicate environment variable " + q(var)};
+
+    if (el.env_.size) // re-bound; the old name stays in the index, but no longer matches
+        --envs_n_;
+
+    el.env_ = intern(var);
+    envs_idx_.insert(var, n);
+    ++envs_n_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename T>
+void args::store(std::string_view name, T* dest)
+{
+    auto n = find_option(name);
+    if (n == index::npos)
+        throw invalid_definition{"unrecognized option " + q(name)};
+
+    auto& el = details_[n];
+    options_[n].spec_ |= key::has_store;
+
+    if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool>)
+        if (!options_[n].value()) // count occurrences
+        {
+            el.store_ = [dest](std::string_view){ ++*dest; return std::errc{}; };
+            return;
+        }
+
+    el.store_ = [dest](std::string_view val){ return store_value(val, *dest); };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline void args::add_command(std::string name, std::string description, std::function<args()> fn)
+{
+    if (!is_param_name(name))
+        throw invalid_definition{"bad command name " + q(name)};
+
+    if (params_.size())
+        throw invalid_definition{"command " + q(name) + " added to args with params"};
+
+    if (commands_idx_.find(name, [&](auto n){ return commands_[n].name_ == name; }) != index::npos)
+        throw invalid_definition{"duplicate command " + q(name)};
+
+    commands_idx_.insert(name, commands_.size());
+    cells_.max = std::max(cells_.max, name.size());
+
+    commands_.push_back(command_def{ std::move(name), std::move(description), std::move(fn) });
+}
+
+inline args const& parse_result::command_args() const
+{
+    if (command_.empty()) throw invalid_argument{"no command"};
+    return *cmd_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+
+template<typename T>
+inline auto pop(std::pmr::deque<T>& q)
+{
+    auto el = q.front();
+    q.pop_front();
+    return el;
+}
+
+inline bool is_not_option(std::string_view s)
+{
+    return s.empty() || s == "-" || s[0] != '-';
+}
+
+constexpr bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+//! @brief return length of shell-style word at the start of `s`
+//! or npos, if it has an unterminated quote
+//! @param plain set to true, if the word has no quotes or escapes
+inline std::size_t shell_word(std::string_view s, bool& plain)
+{
+    plain = true;
+    char quote = 0;
+
+    for (std::size_t n = 0; n < s.size(); ++n)
+    {
+        auto c = s[n];
+        if (quote == '\'')
+        {
+            if (c == '\'') quote = 0;
+        }
+        else if (c == '\\')
+        {
+            plain = false;
+            if (n + 1 < s.size()) ++n; // skip escaped char
+        }
+        else if (quote == '"')
+        {
+            if (c == '"') quote = 0;
+        }
+        else if (c == '\'' || c == '"')
+        {
+            plain = false;
+            quote = c;
+        }
+        else if (is_space(c)) return n;
+    }
+    return quote ? s.npos : s.size();
+}
+
+//! @brief remove quotes and escapes from shell-style `word` writing the result into `out`
+//! @return size of the result, which never exceeds the size of `word`;
+//! `out` can point to `word.data()`
+inline std::size_t unquote(std::string_view word, char* out)
+{
+    std::size_t size = 0;
+    char quote = 0;
+
+    for (std::size_t n = 0; n < word.size(); ++n)
+    {
+        auto c = word[n];
+        if (quote == '\'')
+        {
+            if (c == '\'') quote = 0;
+            else out[size++] = c;
+        }
+        else if (c == '\\' && n + 1 < word.size())
+        {
+            auto e = word[++n];
+            // inside double quotes, backslash only escapes these
+            if (quote == '"' && e != '"' && e != '\\' && e != '$' && e != '`' && e != '\n')
+                out[size++] = c;
+
+            if (e != '\n') out[size++] = e; // backslash-newline is a line continuation
+        }
+        else if (quote == '"')
+        {
+            if (c == '"') quote = 0;
+            else out[size++] = c;
+        }
+        else if (c == '\'' || c == '"') quote = c;
+        else out[size++] = c;
+    }
+    return size;
+}
+
+/*! @brief split `s` into shell-style words and append them to `tokens`
+ *
+ *  Words without quotes or escapes are appended as views into `s`. Others are
+ *  passed to `fn`, which should return the result of unquote().
+ *
+ *  @return false, if `s` has an unterminated quote
+ */
+template<typename Tokens, typename Fn>
+bool split_shell(std::string_view s, Tokens& tokens, Fn&& fn)
+{
+    for (std::size_t n = 0; n < s.size(); )
+    {
+        if (is_space(s[n])) { ++n; continue; }
+
+        bool plain;
+        auto len = shell_word(s.substr(n), plain);
+        if (len == s.npos) return false;
+
+        if (plain) tokens.emplace_back(s.substr(n, len));
+        else tokens.emplace_back(fn(s.substr(n, len)));
+        n += len;
+    }
+    return true;
+}
+
+//! @brief split `s` into non-empty lines or NUL-terminated strings
+inline void split_lines(std::string_view s, std::pmr::vector<std::string_view>& tokens)
+{
+    while (s.size())
+    {
+        auto n = s.find_first_of(std::string_view{"\n\0", 2});
+
+        auto line = s.substr(0, n);
+        if (line.size() && line.back() == '\r') line.remove_suffix(1);
+        if (line.size()) tokens.push_back(line);
+
+        if (n == s.npos) break;
+        s.remove_prefix(n + 1);
+    }
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline bool args::map_file(std::string_view path, parse_result& res, char*& data, std::size_t& size) const
+{
+    std::string name{path};
+    data = nullptr;
+    size = 0;
+
+#if __has_include(<sys/mman.h>)
+    struct stat st;
+    auto fd = ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0 || ::fstat(fd, &st) < 0)
+    {
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+
+    // pipes, FIFOs and files in /proc report size 0 and can't be mapped
+    if (S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        size = static_cast<std::size_t>(st.st_size);
+
+        // private writable mapping, so that words can be unquoted in place
+        auto p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            ::close(fd);
+            data = static_cast<char*>(p);
+            res.files_.emplace_back(p, [size](void* p){ ::munmap(p, size); }, std::pmr::polymorphic_allocator<char>{res.resource()});
+            return true;
+        }
+    }
+
+    // otherwise read it into owned storage
+    auto& buf = res.owned_.emplace_back();
+    for (char chunk[4096];;)
+    {
+        auto n = ::read(fd, chunk, sizeof(chunk));
+        if (n > 0) buf.append(chunk, static_cast<std::size_t>(n));
+        else if (n == 0) break;
+        else if (errno != EINTR)
+        {
+            ::close(fd);
+            return false;
+        }
+    }
+    ::close(fd);
+
+    PGM_ARGS_STAT(res.stats_.bytes += buf.size();)
+    data = buf.data();
+    size = buf.size();
+#else
+    std::ifstream ifs{name, std::ios::binary};
+    if (!ifs) return false;
+
+    auto& buf = res.owned_.emplace_back(std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{});
+    PGM_ARGS_STAT(res.stats_.bytes += buf.size();)
+    data = buf.data();
+    size = buf.size();
+#endif
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline parse_errc args::read_file(std::string_view path, parse_result& res, std::pmr::vector<std::string_view>& tokens) const
+{
+    char* data;
+    std::size_t size;
+    if (!map_file(path, res, data, size)) return parse_errc::bad_response_file;
+
+    if (rsp_ == response::shell)
+    {
+        // unquote in place
+        auto fn = [&](std::string_view word){
+            auto p = data + (word.data() - data);
+            return std::string_view{p, unquote(word, p)};
+        };
+        if (!split_shell({data, size}, tokens, fn)) return parse_errc::unterminated_quote;
+    }
+    else split_lines({data, size}, tokens);
+
+    return parse_errc::none;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline void args::parse(int argc, char* argv[], parse_result& res) const
+{
+    if (auto err = try_parse(argc, argv, res)) err.raise();
+}
+
+inline parse_error args::try_parse(int argc, char* argv[], parse_result& res) const
+{
+    std::pmr::deque<std::string_view> args{res.resource()};
+    for (auto n = 1; n < argc; ++n) args.emplace_back(argv[n]);
+
+    return try_parse(args, res);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline void args::parse(std::string_view cmdline, parse_result& res) const
+{
+    if (auto err = try_parse(cmdline, res)) err.raise();
+}
+
+inline parse_error args::try_parse(std::string_view cmdline, parse_result& res) const
+{
+    PGM_ARGS_STAT(auto time = std::chrono::steady_clock::now();)
+    std::pmr::deque<std::string_view> args{res.resource()};
+
+    // copy words that need unquoting
+    auto fn = [&](std::string_view word){
+        auto& buf = res.owned_.emplace_back(word);
+        buf.resize(unquote(word, buf.data()));
+        PGM_ARGS_STAT(res.stats_.bytes += word.size();)
+        return std::string_view{buf};
+    };
+    if (!split_shell(cmdline, args, fn)) return parse_error{this, parse_errc::unterminated_quote, parse_error::npos, parse_error::npos, { }};
+
+    PGM_ARGS_STAT(res.stats_.tokenize += std::chrono::steady_clock::now() - time;)
+
+    return try_parse(args, res);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline parse_error args::try_parse(std::pmr::deque<std::string_view>& args, parse_result& res) const
+{
+    if (res.args_ != this || res.version_ != version_) bind(res);
+
+    bool had_token = false;
+    std::pmr::deque<std::tuple<std::string_view, std::size_t>> saved{res.resource()}; // params and their token index
+
+    std::size_t token = 0; // # of tokens taken so far
+    auto error = [&](parse_errc kind, std::size_t token, std::size_t slot, std::string_view text){
+        return parse_error{this, kind, token, slot, text};
+    };
+
+    auto put = [&](std::size_t n, std::string_view value, std::size_t token){ return add_value(n, value, token, res); };
+
+    // streamed multi-value param and # of params before and after it
+    auto streamed = std::find_if(params_.begin(), params_.end(), [](auto&& el){ return el.stream_ != nullptr; });
+    std::size_t before = streamed - params_.begin(), after = params_.end() - streamed - 1;
+
+    // # of tokens from each nested response file remaining in args
+    std::pmr::vector<std::size_t> nested{res.resource()};
+    auto next = [&]{
+        while (nested.size() && !nested.back()) nested.pop_back();
+        if (nested.size()) --nested.back();
+        ++token;
+        PGM_ARGS_STAT(++res.stats_.tokens;)
+        return pop(args);
+    };
+
+    // add time since the last lap to `phase`
+    PGM_ARGS_STAT(
+        auto time = std::chrono::steady_clock::now();
+        auto lap = [&](parse_stats::duration& phase){
+            auto now = std::chrono::steady_clock::now();
+            phase += now - time;
+            time = now;
+        };
+    )
+
+    while (args.size())
+    {
+        auto arg = next();
+        auto at = token - 1;
+
+        if (rsp_ != response::none && !had_token && arg.size() > 1 && arg[0] == '@') // response file
+        {
+            if (nested.size() >= rsp_depth_)
+                return error(parse_errc::nested_response_file, at, parse_error::npos, arg.substr(1));
+
+            PGM_ARGS_STAT(lap(res.stats_.match);)
+
+            std::pmr::vector<std::string_view> tokens{res.resource()};
+            if (auto kind = read_file(arg.substr(1), res, tokens); kind != parse_errc::none)
+                return error(kind, at, parse_error::npos, arg.substr(1));
+
+            PGM_ARGS_STAT(lap(res.stats_.tokenize);)
+
+            args.insert(args.begin(), tokens.begin(), tokens.end());
+            nested.push_back(tokens.size());
+        }
+        else if (commands_.size() && (had_token || is_not_option(arg))) // subcommand
+        {
+            auto n = commands_idx_.find(arg, [&](auto n){ return commands_[n].name_ == arg; });
+            if (n == index::npos)
+                return error(parse_errc::unrecognized_command, at, parse_error::npos, arg);
+
+            if (!res.cmd_ || res.cmd_pos_ != n)
+            {
+                res.cmd_ = std::allocate_shared<pgm::args>(std::pmr::polymorphic_allocator<char>{res.resource()}, commands_[n].make_());
+                res.cmd_pos_ = n;
+            }
+            res.command_ = arg;
+            break; // the rest is parsed below
+        }
+        else if (had_token || is_not_option(arg)) // param ("", "-" or re: "[^-].+")
+        {
+            saved.emplace_back(arg, at); // process at the end
+            PGM_ARGS_STAT(++res.stats_.params;)
+
+            // once there are enough values to fill all other params (plus
+            // one extra to keep the logic below intact), this one belongs
+            // to the streamed param
+            if (streamed != params_.end() && saved.size() > before + after + 1)
+            {
+                auto it = saved.begin() + before;
+                streamed->stream_(std::get<0>(*it));
+                saved.erase(it);
+            }
+        }
+
+        else if (arg == "--") // end-of-options token
+            had_token = true;
+
+        else for (std::size_t i = 1; i < arg.size(); ) // option (re: "-.+")
+        {
+            std::size_t n;
+            std::string_view name, text; // text = name in arg
+            std::optional<std::string_view> value;
+
+            char short_name[] = { '-', arg[i] };
+            PGM_ARGS_STAT(if (i == 2 && arg[1] != '-') ++res.stats_.short_groups;)
+
+            auto option_error = [&](parse_errc kind, std::size_t slot)
+            {
+                auto err = error(kind, at, slot, text);
+                err.short_name = arg[1] != '-';
+                return err;
+            };
+
+            if (arg[1] == '-') // long option (re: "--.+")
+            {
+                auto p = arg.find('=', 2);
+                if (p != arg.npos) // with value (re: "--[^=]+=.?")
+                {
+                    name = arg.substr(0, p);
+                    value = arg.substr(p + 1);
+                }
+                else name = arg; // without value (re: "--[^=]+")
+
+                text = name;
+                i = arg.size();
+
+                bool ambiguous = false;
+                n = find_abbrev(name, ambiguous);
+                if (ambiguous) return option_error(parse_errc::ambiguous_option, parse_error::npos);
+            }
+            else // short option (re: -[^-].?)
+            {
+                name = std::string_view{short_name, 2};
+                text = arg.substr(i, 1);
+                if (++i < arg.size()) value = arg.substr(i); // with value (re: "-[^-].+")
+
+                n = find_short(short_name[1]);
+            }
+
+            // find matching definition
+            if (n == index::npos)
+                return option_error(parse_errc::unrecognized_option, parse_error::npos);
+
+            auto it = options_.begin() + n;
+            auto& values = res.options_[n];
+            if (values.config_) values.clear(); // command line overrides config file
+
+            if (!it->value()) // doesn't take values
+            {
+                // but we have one, which for a short option means that
+                // this is a group (eg, -abc) and we continue with the rest
+                if (value && name.size() > 2)
+                    return option_error(parse_errc::unexpected_value, n);
+
+                value = ""; // indicate presence
+            }
+            else
+            {
+                i = arg.size(); // value consumes the rest of the arg
+
+                if (it->optval()) // optional value
+                {
+                    if (!value) // and we don't have one
+                    {
+                        // take the next arg, if it's not an option
+                        if (args.size() && is_not_option(args[0]))
+                            value = next();
+                        else value = ""; // or indicate presence
+                    }
+                }
+                else // requires value
+                {
+                    if (!value) // but we don't have one
+                    {
+                        // take the next arg unless it's "--"
+                        if (args.size() && args[0] != "--")
+                            value = next();
+                        else return option_error(parse_errc::missing_value, n);
+                    }
+                }
+            }
+
+            if (!it->mul() && !values.empty())
+                return option_error(parse_errc::duplicate_option, n);
+
+            // token - 1 is the one the value came from
+            if (auto err = put(n, *value, token - 1)) return err;
+
+            // skip everything else, including the checks below
+            if (it->stop())
+            {
+                res.stop_ = n;
+                return { };
+            }
+        }
+    }
+
+    // options not given on the command line are taken from their
+    // environment variables in one pass
+    if (envs_n_)
+    {
+#if defined(_WIN32)
+        auto vars = _environ;
+#else
+        auto vars = environ;
+#endif
+        for (; vars && *vars; ++vars)
+        {
+            std::string_view var{*vars};
+            auto p = var.find('=');
+            if (p == var.npos) continue;
+
+            auto name = var.substr(0, p), value = var.substr(p + 1);
+            auto n = envs_idx_.find(name, [&](auto n){ return view(details_[n].env_) == name; });
+            if (n == index::npos) continue;
+
+            if (res.options_[n].config_) res.options_[n].clear(); // environment overrides config file
+            else if (!res.options_[n].empty()) continue;
+
+            if (!options_[n].value()) // flag (eg, APP_VERBOSE=1)
+            {
+                bool on = false;
+                if (convert(value, on) != std::errc{} || !on) continue;
+                value = "";
+            }
+            if (auto err = put(n, value, parse_error::npos)) return err;
+        }
+    }
+
+    // config file values that weren't overridden above
+    if (auto err = send_pending(res)) return err;
+    res.parsed_ = true;
+
+    PGM_ARGS_STAT(lap(res.stats_.match);)
+
+    // check required options
+    for (std::size_t n = 0; n < options_.size(); ++n)
+        if (options_[n].req() && res.options_[n].empty())
+            return error(parse_errc::missing_option, parse_error::npos, n, { });
+
+    PGM_ARGS_STAT(lap(res.stats_.check);)
+
+    // process params
+    auto req_n = std::count_if(params_.begin(), params_.end(),
+        [&](auto const& el){ return !el.opt_; }
+    ); // # of non-opt params to fill
+
+    for (auto it = params_.begin(), end = params_.end(); it != end; ++it)
+    {
+        if (!it->opt_) --req_n;
+        else if (saved.size() <= req_n) continue; // not enough for opt params
+
+        if (saved.size())
+        {
+            do
+            {
+                auto value = std::get<0>(pop(saved));
+                if (it->stream_) it->stream_(value);
+                else res.params_[it - params_.begin()].add(value);
+            }
+            while (it->mul_ && saved.size() >= end - it); // munch extra values
+        }
+        else return error(parse_errc::missing_param, parse_error::npos, it - params_.begin(), { });
+    }
+
+    PGM_ARGS_STAT(lap(res.stats_.assign);)
+
+    if (saved.size())
+        return error(parse_errc::extra_param, std::get<1>(saved[0]), parse_error::npos, std::get<0>(saved[0]));
+
+    if (commands_.size())
+    {
+        if (res.command_.empty())
+            return error(parse_errc::missing_command, parse_error::npos, parse_error::npos, { });
+
+        auto err = res.cmd_->try_parse(args, res.cmd_->result_);
+        if (err.token != parse_error::npos) err.token += token; // relative to the whole command line
+
+        return err;
+    }
+
+    return { };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline parse_error args::add_value(std::size_t n, std::string_view value, std::size_t token, parse_result& res) const
+{
+    PGM_ARGS_STAT(++res.stats_.options;)
+
+    auto sep = options_[n].sep_;
+    if (!sep || value.empty()) return add_one(n, value, token, res);
+
+    // single scan with memchr, which is vectorized by the C library
+    for (auto p = value.data(), e = p + value.size();;)
+    {
+        auto d = static_cast<char const*>(std::memchr(p, sep, static_cast<std::size_t>(e - p)));
+        auto end = d ? d : e;
+
+        if (auto err = add_one(n, std::string_view(p, static_cast<std::size_t>(end - p)), token, res)) return err;
+        if (!d) break;
+        p = d + 1;
+    }
+    return { };
+}
+
+inline parse_error args::add_one(std::size_t n, std::string_view value, std::size_t token, parse_result& res) const
+{
+    auto& el = options_[n];
+
+    std::uint64_t choice = 0;
+    if (el.choices_ && !find_choice(choices_[el.choices_ - 1], value, choice))
+        return parse_error{this, parse_errc::bad_value, token, n, value};
+
+    if (el.store())
+    {
+        if (auto ec = details_[n].store_(value); ec != std::errc{}) return parse_error{this,
+            ec == std::errc::result_out_of_range ? parse_errc::out_of_range : parse_errc::bad_value,
+            token, n, value
+        };
+        res.options_[n].seen();
+    }
+    else
+    {
+        res.options_[n].add(value);
+        if (el.choices_) res.options_[n].choices_.push_back(choice);
+    }
+    PGM_ARGS_STAT(++res.stats_.values;)
+
+    return { };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline void args::choices(std::string_view name, std::initializer_list<std::string_view> set)
+{
+    add_choices(name, set, false);
+}
+
+inline void args::flag_set(std::string_view name, std::initializer_list<std::string_view> set)
+{
+    if (set.size() > 64) throw invalid_definition{"more than 64 flags for " + q(name)};
+    add_choices(name, set, true);
+}
+
+inline void args::add_choices(std::string_view name, std::initializer_list<std::string_view> set, bool mask)
+{
+    auto n = find_option(name);
+    if (n == index::npos)
+        throw invalid_definition{"unrecognized option " + q(name)};
+
+    else if (!options_[n].value())
+        throw invalid_definition{"option " + q(name) + " doesn't take values"};
+
+    choice_set cs;
+    cs.mask_ = mask;
+    for (auto val : set)
+    {
+        if (val.empty() || (mask && val.find(',') != val.npos))
+            throw invalid_definition{"bad choice " + q(val) + " for " + q(name)};
+
+        if (cs.idx_.find(val, [&](auto n){ return view(cs.names_[n]) == val; }) != index::npos)
+            throw invalid_definition{"duplicate choice " + q(val) + " for " + q(name)};
+
+        cs.idx_.insert(val, cs.names_.size());
+        cs.names_.push_back(intern(val));
+    }
+
+    auto& el = options_[n];
+    if (el.choices_) choices_[el.choices_ - 1] = std::move(cs);
+    else
+    {
+        choices_.push_back(std::move(cs));
+        el.choices_ = static_cast<std::uint32_t>(choices_.size());
+    }
+}
+
+inline void args::separator(std::string_view name, char sep)
+{
+    auto n = find_option(name);
+    if (n == index::npos)
+        throw invalid_definition{"unrecognized option " + q(name)};
+
+    else if (!options_[n].value())
+        throw invalid_definition{"option " + q(name) + " doesn't take values"};
+
+    else if (!sep)
+        throw invalid_definition{"invalid separator for " + q(name)};
+
+    options_[n].sep_ = sep;
+}
+
+inline bool args::find_choice(choice_set const& cs, std::string_view value, std::uint64_t& choice) const
+{
+    auto find = [&](std::string_view val){
+        return cs.idx_.find(val, [&](auto n){ return view(cs.names_[n]) == val; });
+    };
+
+    if (!cs.mask_)
+    {
+        if (value.empty()) // optval without value
+        {
+            choice = static_cast<std::uint64_t>(-1);
+            return true;
+        }
+
+        auto n = find(value);
+        choice = n;
+        return n != index::npos;
+    }
+
+    choice = 0;
+    while (value.size())
+    {
+        auto p = value.find(',');
+        auto n = find(value.substr(0, p));
+        if (n == index::npos) return false;
+
+        choice |= std::uint64_t{1} << n;
+        value.remove_prefix(p == value.npos ? value.size() : p + 1);
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+
+inline auto trim(std::string_view s)
+{
+    while (s.size() && is_space(s.front())) s.remove_prefix(1);
+    while (s.size() && is_space(s.back())) s.remove_suffix(1);
+    return s;
+}
+
+}
+
+inline void args::parse_config(std::string_view path, parse_result& res) const
+{
+    if (auto err = try_parse_config(path, res)) err.raise();
+}
+
+inline parse_error args::try_parse_config(std::string_view path, parse_result& res) const
+{
+    if (res.args_ != this || res.version_ != version_) bind(res);
+
+    auto error = [&](parse_errc kind, std::size_t token, std::size_t slot, std::string_view text){
+        parse_error err{this, kind, token, slot, text};
+        err.config_ = path;
+        return err;
+    };
+
+    char* data;
+    std::size_t size;
+    if (!map_file(path, res, data, size)) return error(parse_errc::bad_config_file, parse_error::npos, parse_error::npos, path);
+
+    auto config = ++res.configs_;
+    std::string_view stored_path; // see parse_result::pending
+
+    std::string_view s{data, size};
+    for (std::size_t line = 0; s.size(); ++line)
+    {
+        auto p = s.find('\n');
+        auto ln = trim(s.substr(0, p));
+        s.remove_prefix(p == s.npos ? s.size() : p + 1);
+
+        if (ln.empty() || ln[0] == '#' || ln[0] == ';') continue; // comment
+
+        // key [= value]
+        std::optional<std::string_view> value;
+        p = ln.find('=');
+
+        auto key = trim(ln.substr(0, p));
+        if (p != ln.npos)
+        {
+            value = trim(ln.substr(p + 1));
+            if (value->size() > 1 && (value->front() == '"' || value->front() == '\'') && value->back() == value->front())
+                value = value->substr(1, value->size() - 2); // "quoted value"
+        }
+
+        // look up --key
+        char buf[64];
+        std::string long_buf;
+        std::string_view name;
+
+        if (key.size() + 2 <= sizeof(buf))
+        {
+            buf[0] = buf[1] = '-';
+            std::copy(key.begin(), key.end(), buf + 2);
+            name = std::string_view{buf, key.size() + 2};
+        }
+        else name = long_buf = "--" + std::string{key};
+
+        if (!is_long_option(name))
+            return error(parse_errc::bad_config_line, line, parse_error::npos, ln);
+
+        auto n = find_option(name);
+        if (n == index::npos) return error(parse_errc::unrecognized_option, line, parse_error::npos, key);
+
+        auto& el = options_[n];
+        auto& values = res.options_[n];
+        if (!values.empty() && !values.config_) continue; // set on the command line or from the environment
+        if (values.config_ && values.config_ != config) // set by an earlier config file
+        {
+            if (el.store() && res.parsed_) continue; // and already sent to store()
+            values.clear();
+        }
+
+        if (!el.value()) // doesn't take values
+        {
+            bool on = true;
+            if (value && convert(*value, on) != std::errc{})
+                return error(parse_errc::bad_value, line, n, *value);
+
+            if (!on) continue;
+            value = "";
+        }
+        else if (!value)
+        {
+            if (el.optval()) value = "";
+            else return error(parse_errc::missing_value, line, n, key);
+        }
+
+        if (!el.mul() && !values.empty())
+            return error(parse_errc::duplicate_option, line, n, key);
+
+        if (el.store()) // held until the command line and environment are parsed
+        {
+            if (stored_path.empty()) stored_path = res.owned_.emplace_back(path);
+            res.pending_.push_back({ n, *value, line, config, stored_path });
+            values.seen();
+        }
+        else if (auto err = add_value(n, *value, line, res))
+        {
+            err.config_ = path;
+            return err;
+        }
+        values.config_ = config;
+    }
+
+    return res.parsed_ ? send_pending(res) : parse_error{ };
+}
+
+inline parse_error args::send_pending(parse_result& res) const
+{
+    auto& pending = res.pending_;
+
+    // drop values overridden since then (which resets config_) and count the rest anew
+    pending.erase(std::remove_if(pending.begin(), pending.end(),
+        [&](auto& el){ return res.options_[el.n].config_ != el.config; }
+    ), pending.end());
+    for (auto&& el : pending) res.options_[el.n].count_ = 0;
+
+    parse_error err;
+    for (auto&& el : pending)
+        if ((err = add_value(el.n, el.value, el.line, res)))
+        {
+            err.config_ = el.path;
+            break;
+        }
+
+    pending.clear();
+    return err;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline bool parse_error::is_missing() const
+{
+    return kind == parse_errc::missing_value || kind == parse_errc::missing_option || kind == parse_errc::missing_param
+        || kind == parse_errc::missing_command;
+}
+
+inline std::string parse_error::why() const
+{
+    // short options are stored as just the char
+    auto name = short_name ? "-" + std::string{text} : std::string{text};
+
+    // config files name options by key, so use the canonical name instead
+    if (config_.size() && slot != npos)
+    {
+        auto& el = args_->options_[slot];
+        name = args_->view(el.long_.size ? el.long_ : el.short_);
+    }
+
+    switch (kind)
+    {
+    case parse_errc::unrecognized_option: return "unrecognized option " + q(name);
+    case parse_errc::ambiguous_option: return "option " + q(name) + " is ambiguous";
+    case parse_errc::unexpected_value: return q(name) + " doesn't take values";
+    case parse_errc::missing_value: return q(name) + " requires a value";
+    case parse_errc::duplicate_option: return "duplicate option " + q(name);
+
+    case parse_errc::missing_option:
+        {
+            auto& el = args_->options_[slot];
+            auto short_name = args_->view(el.short_), long_name = args_->view(el.long_);
+            return "option " + q(short_name.empty() ? long_name : long_name.empty() ? short_name
+                : std::string{short_name} + ", " + std::string{long_name}) + " is required";
+        }
+    case parse_errc::missing_param: return "param " + q(args_->params_[slot].name_) + " is required";
+    case parse_errc::extra_param: return "extra param " + q(text);
+
+    case parse_errc::bad_value: case parse_errc::out_of_range:
+        {
+            auto& el = args_->options_[slot];
+            auto opt = q(args_->view(el.long_.size ? el.long_ : el.short_));
+            return kind == parse_errc::bad_value ? "bad value " + q(text) + " for " + opt
+                : "value " + q(text) + " is out of range for " + opt;
+        }
+    case parse_errc::unrecognized_command: return "unrecognized command " + q(text);
+    case parse_errc::missing_command: return "command is required";
+
+    case parse_errc::unterminated_quote:
+        return text.size() ? "unterminated quote in response file " + q(text) : "unterminated quote";
+
+    case parse_errc::bad_response_file: return "cannot read response file " + q(text);
+    case parse_errc::bad_config_file: return "cannot read config file " + q(text);
+    case parse_errc::bad_config_line: return "bad line " + q(text);
+    case parse_errc::nested_response_file: return "response file " + q(text) + " is nested too deeply";
+
+    default: return "no error";
+    }
+}
+
+inline std::string parse_error::where() const
+{
+    if (config_.empty() || token == npos) return { };
+    return " in config file " + q(config_) + ", line " + std::to_string(token + 1);
+}
+
+inline std::string parse_error::message() const
+{
+    return (is_missing() ? "Missing argument: " : "Invalid argument: ") + why() + where() + ".";
+}
+
+inline void parse_error::raise() const
+{
+    if (is_missing()) throw missing_argument{why() + where()};
+    else throw invalid_argument{why() + where()};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline bool args::takes_next(std::string_view arg) const
+{
+    if (arg.size() > 1 && arg[1] == '-') // --opt-name
+    {
+        if (arg.find('=') != arg.npos) return false;
+
+        bool ambiguous = false;
+        auto n = find_abbrev(arg, ambiguous);
+        return n != index::npos && options_[n].value() && !options_[n].optval();
+    }
+
+    for (std::size_t i = 1; i < arg.size(); ++i) // -abc
+    {
+        auto n = find_short(arg[i]);
+        if (n == index::npos) return false;
+
+        if (options_[n].value()) // takes the rest or the next arg
+            return i + 1 == arg.size() && !options_[n].optval();
+    }
+    return false;
+}
+
+inline bool args::complete(int argc, char* argv[], std::ostream& os) const
+{
+    if (argc < 2 || std::string_view{argv[1]} != "--complete") return false;
+
+    complete(argv + 2, argv + argc, os);
+    return true;
+}
+
+inline void args::complete(char** first, char** last, std::ostream& os) const
+{
+    std::string_view word = first != last ? *--last : "";
+
+    bool value = false; // next word is an option value
+    for (bool had_token = false; first != last; ++first)
+    {
+        std::string_view arg = *first;
+
+        if (value) value = false;
+        else if (had_token || is_not_option(arg))
+        {
+            if (commands_.empty()) continue; // param
+
+            auto n = commands_idx_.find(arg, [&](auto n){ return commands_[n].name_ == arg; });
+            if (n != index::npos) commands_[n].make_().complete(first + 1, last + 1, os);
+            return;
+        }
+        else if (arg == "--") had_token = true;
+        else value = takes_next(arg);
+    }
+    if (value) return;
+
+    auto put = [&](std::string_view name){ os.write(name.data(), name.size()); os.put('\n'); };
+
+    if (word.substr(0, 2) == "--") // long options
+        for (auto name : complete(word)) put(name);
+
+    else if (word.size() && word[0] == '-') // short options
+    {
+        for (auto&& el : options_)
+            if (el.short_.size && view(el.short_).substr(0, word.size()) == word) put(view(el.short_));
+
+        if (word == "-") for (auto name : complete("--")) put(name);
+    }
+    else for (auto&& el : commands_) // commands
+        if (std::string_view{el.name_}.substr(0, word.size()) == word) put(el.name_);
+}
+
+inline void args::completion_script(std::ostream& os, std::string_view program, shell sh) const
+{
+    // function name
+    std::string fn = "_";
+    for (auto c : program) fn += is_alnum(c) ? c : '_';
+
+    if (sh == shell::zsh) os << "#compdef " << program << "\n"
+        "autoload -U +X bashcompinit && bashcompinit\n";
+
+    os << fn << "()\n{\n";
+    if (commands_.size()) // ask the program
+    {
+        os << "    local IFS=$'\\n'\n"
+              "    COMPREPLY=($(\"${COMP_WORDS[0]}\" --complete \"${COMP_WORDS[@]:1:COMP_CWORD}\" 2>/dev/null))\n";
+    }
+    else
+    {
+        os << "    local cur=${COMP_WORDS[COMP_CWORD]} prev=${COMP_WORDS[COMP_CWORD-1]}\n";
+
+        // options that take the next arg as their value
+        std::string values;
+        for (auto&& el : options_)
+            if (el.value() && !el.optval())
+                for (auto name : { view(el.short_), view(el.long_) })
+                    if (name.size())
+                    {
+                        if (values.size()) values += '|';
+                        values += name;
+                    }
+        if (values.size()) os << "    case $prev in " << values << ") return;; esac\n";
+
+        os << "    [[ $cur == -* ]] && COMPREPLY=($(compgen -W \"";
+        auto sep = "";
+        for (auto&& el : options_)
+        {
+            if (el.short_.size) os << sep << view(el.short_), sep = " ";
+            if (el.long_.size) os << sep << view(el.long_), sep = " ";
+        }
+        os << "\" -- \"$cur\"))\n";
+    }
+    os << "}\n"
+          "complete -o default -F " << fn << " " << program << "\n";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename Filter>
+void args::to_argv(argv_buffer& out, parse_result const& res, std::string_view program, Filter filter) const
+{
+    // measure
+    std::size_t size = 0, argc = 0;
+    auto count = [&](std::string_view s){ size += s.size(); };
+    auto count_end = [&]{ ++size; ++argc; };
+
+    count(program);
+    count_end();
+    serialize(res, filter, count, count_end);
+
+    // and write
+    out.buf_.resize(size);
+    out.ptrs_.clear();
+    out.ptrs_.reserve(argc + 1);
+
+    auto p = out.buf_.data(), start = p;
+    auto write = [&](std::string_view s){ p = std::copy(s.begin(), s.end(), p); };
+    auto write_end = [&]{
+        *p++ = '\0';
+        out.ptrs_.push_back(start);
+        start = p;
+    };
+
+    write(program);
+    write_end();
+    serialize(res, filter, write, write_end);
+
+    out.ptrs_.push_back(nullptr);
+}
+
+template<typename Filter, typename Put, typename End>
+void args::serialize(parse_result const& res, Filter& filter, Put& put, End& end) const
+{
+    bool had_token = false, need_token = false; // "--" written or needed before params
+
+    for (std::size_t n = 0; n < options_.size() && n < res.options_.size(); ++n)
+    {
+        auto& el = options_[n];
+        auto& values = res.options_[n];
+
+        bool is_long = el.long_.size;
+        auto name = view(is_long ? el.long_ : el.short_);
+        if (values.empty() || !filter(name)) continue;
+
+        if (!el.value()) // flag, possibly counted by store()
+        {
+            for (std::size_t i = 0; i < values.count(); ++i) put(name), end();
+            continue;
+        }
+
+        // write `name` with value(s) from `write`
+        auto option = [&](bool empty, auto&& write)
+        {
+            put(name);
+            if (is_long) put("="), write(), end(); // --opt-name=value or --opt-name=
+            else if (empty) // -o ""
+            {
+                end();
+                if (!el.optval()) end();
+                else need_token = true; // or the next param becomes its value
+            }
+            else write(), end(); // -ovalue
+        };
+
+        auto& data = values.values();
+        if (data.empty()) continue; // values were passed to store() or stream()
+
+        if (el.sep_) // --opt-name=val1,val2,...
+        {
+            bool empty = data.size() == 1 && data[0].empty();
+            option(empty, [&]{
+                for (std::size_t i = 0; i < data.size(); ++i)
+                {
+                    if (i) put(std::string_view{&el.sep_, 1});
+                    put(data[i]);
+                }
+            });
+        }
+        else for (auto value : data) option(value.empty(), [&]{ put(value); });
+    }
+
+    for (std::size_t n = 0; n < params_.size() && n < res.params_.size(); ++n)
+    {
+        if (!filter(std::string_view{params_[n].name_})) continue;
+
+        for (auto value : res.params_[n].values())
+        {
+            // values that look like options or response files follow "--"
+            if (!had_token && (need_token || !is_not_option(value) || (rsp_ != response::none && value.size() > 1 && value[0] == '@')))
+            {
+                put("--");
+                end();
+                had_token = true;
+            }
+            put(value);
+            end();
+        }
+    }
+
+    if (res.command_.size() && res.cmd_)
+    {
+        if (need_token && !had_token) put("--"), end();
+        put(res.command_);
+        end();
+        res.cmd_->serialize(res.cmd_->result_, filter, put, end);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline args::str args::make_cell(key const& el, std::string_view valname)
+{
+    // names are appended from pool_ itself, so make room first
+    auto pos = pool_.size();
+    pool_.reserve(pos + el.short_.size + el.long_.size + valname.size() + 5);
+
+    if (el.short_.size)
+    {
+        pool_ += view(el.short_); // "-o"
+        if (el.long_.size)
+        {
+            pool_ += ", "; // "-o, --opt-name"
+            pool_ += view(el.long_);
+            if (valname.size()) pool_ += "="; // "-o, --opt-name="
+        }
+        else if (valname.size()) pool_ += " "; // "-o "
+    }
+    else
+    {
+        pool_ += view(el.long_); // "--opt-name"
+        if (valname.size()) pool_ += "="; // "--opt-name="
+    }
+
+    if (valname.size())
+    {
+        pool_ += el.optval() ? "[" : "<"; // "...[val]"
+        pool_ += valname;                  // or
+        pool_ += el.optval() ? "]" : ">"; // "...<val>"
+    }
+
+    auto size = pool_.size() - pos;
+    if (el.short_.size)
+    {
+        cells_.max = std::max(cells_.max, size);
+        cells_.short_fill = true;
+    }
+    else cells_.long_max = std::max(cells_.long_max, size);
+
+    return str{static_cast<std::uint32_t>(pos), static_cast<std::uint32_t>(size)};
+}
+
+template<typename Fn>
+void args::write_usage(Fn&& put, std::string_view program, std::string_view preamble, std::string_view prologue, std::string_view epilogue) const
+{
+    std::string_view short_fill = cells_.short_fill ? "    " : ""; // filler for "-o, "
+    auto cell_0_max = std::max(cells_.max, short_fill.size() + cells_.long_max);
+
+    auto pad = [&](std::size_t n)
+    {
+        constexpr std::string_view spaces = "                                ";
+        for (; n < cell_0_max; n += spaces.size()) put(spaces.substr(0, cell_0_max - n));
+    };
+
+    bool first = true;
+    auto row = [&](std::string_view fill, std::string_view cell_0, std::string_view cell_1)
+    {
+        if (!first) put("\n");
+        first = false;
+
+        put(fill);
+        put(cell_0);
+        pad(fill.size() + cell_0.size());
+
+        if (cell_1.size())
+        {
+            put("    ");
+            put(cell_1);
+        }
+    };
+
+    // write description one line at a time
+    auto rows = [&](std::string_view fill, std::string_view cell_0, std::string_view desc)
+    {
+        for (std::size_t p; (p = desc.find('\n')) != desc.npos; desc.remove_prefix(p + 1))
+        {
+            row(fill, cell_0, desc.substr(0, p));
+            fill = cell_0 = { };
+        }
+        row(fill, cell_0, desc);
+    };
+
+    ////////////////////
+    if (preamble.size())
+    {
+        row({ }, preamble, { });
+        row({ }, { }, { });
+    }
+
+    ////////////////////
+    if (!first) put("\n");
+    first = false;
+
+    std::size_t size = 0;
+    auto put_size = [&](std::string_view s){ put(s); size += s.size(); };
+
+    put_size("Usage: ");
+    put_size(program);
+
+    if (options_.size()) put_size(" [option]...");
+    if (commands_.size()) put_size(" <command> [arg]...");
+    for (auto&& el : params_)
+    {
+        put_size(el.opt_ ? " [" : " <");
+        put_size(el.name_);
+        put_size(el.opt_ ? "]" : ">");
+        if (el.mul_) put_size("...");
+    }
+    pad(size);
+
+    ////////////////////
+    if (prologue.size())
+    {
+        row({ }, { }, { });
+        row({ }, prologue, { });
+    }
+
+    ////////////////////
+    if (options_.size())
+    {
+        row({ }, { }, { });
+        row({ }, "Options:", { });
+
+        for (std::size_t n = 0; n < options_.size(); ++n)
+            rows(options_[n].short_.size ? "" : short_fill, view(details_[n].cell_), view(details_[n].description_));
+    }
+
+    ////////////////////
+    if (params_.size())
+    {
+        row({ }, { }, { });
+        row({ }, "Parameters:", { });
+
+        for (auto&& el : params_) rows({ }, el.name_, el.description_);
+    }
+
+    ////////////////////
+    if (commands_.size())
+    {
+        row({ }, { }, { });
+        row({ }, "Commands:", { });
+
+        for (auto&& el : commands_) rows({ }, el.name_, el.description_);
+    }
+
+    ////////////////////
+    if (epilogue.size())
+    {
+        row({ }, { }, { });
+        row({ }, epilogue, { });
+    }
+}
+
+inline void args::usage(std::ostream& os, std::string_view program, std::string_view preamble, std::string_view prologue, std::string_view epilogue) const
+{
+    write_usage([&](std::string_view s){ os.write(s.data(), s.size()); },
+        program, preamble, prologue, epilogue
+    );
+}
+
+inline std::string args::usage(std::string_view program, std::string_view preamble, std::string_view prologue, std::string_view epilogue) const
+{
+    std::string overall;
+    write_usage([&](std::string_view s){ overall += s; },
+        program, preamble, prologue, epilogue
+    );
+    return overall;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+}
+
+#undef PGM_ARGS_STAT
+
 ////////////////////////////////////////////////////////////////////////////////
 #endif
@@ -0,0 +1,206 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "pgm/args.hpp"
+
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// count heap allocations
+static std::atomic<std::size_t> allocs{0};
+
+void* operator new(std::size_t size)
+{
+    ++allocs;
+    if (auto p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc{};
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept
+{
+    ++allocs;
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::nothrow_t const&) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+////////////////////////////////////////////////////////////////////////////////
+struct argcv
+{
+    void add(std::string arg) { args_.push_back(std::move(arg)); }
+
+    auto argc()
+    {
+        argcv_.clear();
+        argcv_.push_back(name_.data());
+        for (auto& arg : args_) argcv_.push_back(arg.data());
+        argcv_.push_back(nullptr);
+
+        return static_cast<int>(argcv_.size() - 1);
+    }
+    auto argv() { return argcv_.data(); }
+
+private:
+    std::string name_ = "pgm";
+    std::vector<std::string> args_;
+    std::vector<char*> argcv_;
+};
+
+//! @brief schema with `n` long options taking values, named --opt-0, --opt-1, etc.
+auto make_schema(std::size_t n)
+{
+    pgm::args args;
+    for (std::size_t i = 0; i < n; ++i)
+        args.add("--opt-" + std::to_string(i), "value", pgm::mul, "option number " + std::to_string(i));
+    return args;
+}
+
+//! @brief run parse() on `p` and report time per token and allocations per parse
+void run_parse(benchmark::State& state, pgm::args& args, argcv& p, std::size_t tokens)
+{
+    auto argc = p.argc();
+    auto argv = p.argv();
+
+    std::size_t count = 0;
+    for (auto _ : state)
+    {
+        args.reset();
+
+        auto before = allocs.load();
+        args.parse(argc, argv);
+        count += allocs.load() - before;
+    }
+
+    state.SetItemsProcessed(state.iterations() * tokens);
+    state.counters["time/token"] = benchmark::Counter(tokens,
+        benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert
+    );
+    state.counters["allocs"] = benchmark::Counter(count, benchmark::Counter::kAvgIterations);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// --opt-N=value
+void parse_long_values(benchmark::State& state)
+{
+    std::size_t options = state.range(0), tokens = state.range(1);
+    auto args = make_schema(options);
+
+    argcv p;
+    for (std::size_t i = 0; i < tokens; ++i) p.add("--opt-" + std::to_string(i % options) + "=value");
+
+    run_parse(state, args, p, tokens);
+}
+BENCHMARK(parse_long_values)->ArgNames({"options", "tokens"})
+    ->ArgsProduct({ {10, 100, 1000}, {10, 1000, 100'000, 1'000'000} });
+
+// --opt-N value
+void parse_separate_values(benchmark::State& state)
+{
+    std::size_t options = state.range(0), tokens = state.range(1);
+    auto args = make_schema(options);
+
+    argcv p;
+    for (std::size_t i = 0; i < tokens / 2; ++i)
+    {
+        p.add("--opt-" + std::to_string(i % options));
+        p.add("value");
+    }
+
+    run_parse(state, args, p, tokens / 2 * 2);
+}
+BENCHMARK(parse_separate_values)->ArgNames({"options", "tokens"})
+    ->ArgsProduct({ {10, 1000}, {10, 1000, 100'000} });
+
+// -abcdefgh
+void parse_short_groups(benchmark::State& state)
+{
+    std::size_t tokens = state.range(0);
+
+    pgm::args args;
+    for (auto c : std::string{"abcdefgh"}) args.add(std::string{'-', c}, pgm::mul, "");
+
+    argcv p;
+    for (std::size_t i = 0; i < tokens; ++i) p.add("-abcdefgh");
+
+    run_parse(state, args, p, tokens);
+}
+BENCHMARK(parse_short_groups)->ArgName("tokens")->RangeMultiplier(100)->Range(10, 100'000);
+
+// SRC... DEST
+void parse_params(benchmark::State& state)
+{
+    std::size_t tokens = state.range(0);
+
+    pgm::args args
+    {
+        { "-v", "--verbose", pgm::mul, "" },
+        { "SRC", pgm::mul, "" },
+        { "DEST", "" },
+    };
+
+    argcv p;
+    for (std::size_t i = 0; i < tokens; ++i) p.add("path/to/source/file-" + std::to_string(i));
+
+    run_parse(state, args, p, tokens);
+}
+BENCHMARK(parse_params)->ArgName("tokens")->RangeMultiplier(100)->Range(10, 1'000'000);
+
+////////////////////////////////////////////////////////////////////////////////
+void lookup_name(benchmark::State& state)
+{
+    std::size_t options = state.range(0);
+    auto args = make_schema(options);
+
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < options; ++i) names.push_back("--opt-" + std::to_string(i));
+
+    std::size_t n = 0, before = allocs.load();
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(args[names[n]]);
+        if (++n == options) n = 0;
+    }
+
+    state.counters["allocs"] = benchmark::Counter(allocs.load() - before, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(lookup_name)->ArgName("options")->RangeMultiplier(10)->Range(10, 1000);
+
+void lookup_id(benchmark::State& state)
+{
+    std::size_t options = state.range(0);
+
+    pgm::args args;
+    std::vector<pgm::argid> ids;
+    for (std::size_t i = 0; i < options; ++i) ids.push_back(args.add("--opt-" + std::to_string(i), ""));
+
+    std::size_t n = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(args[ids[n]]);
+        if (++n == options) n = 0;
+    }
+}
+BENCHMARK(lookup_id)->ArgName("options")->RangeMultiplier(10)->Range(10, 1000);
+
+////////////////////////////////////////////////////////////////////////////////
+void usage(benchmark::State& state)
+{
+    std::size_t options = state.range(0);
+    auto args = make_schema(options);
+
+    std::size_t count = 0;
+    for (auto _ : state)
+    {
+        auto before = allocs.load();
+        benchmark::DoNotOptimize(args.usage("pgm", "preamble", "prologue", "epilogue"));
+        count += allocs.load() - before;
+    }
+
+    state.counters["allocs"] = benchmark::Counter(count, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(usage)->ArgName("options")->RangeMultiplier(10)->Range(10, 1000);
@@ -27,16 +27,14 @@ try
         { "-L",                                 "transform symlink into referent file/dir" },
         {       "--chmod", "CHMOD",             "affect file and/or directory permissions" },
         { "-f", "--filter", "RULES", pgm::mul,  "add a file-filtering RULE" },
-        { "-V", "--version",                    "print the version and exit" },
-        { "-h", "--help",                       "show this help" },
+        { "-V", "--version", pgm::stop,         "print the version and exit" },
+        { "-h", "--help", pgm::stop,            "show this help" },
 
         { "SRC", pgm::mul,                      "source file(s) or directory(s)" },
         { "DEST",                               "destination file or directory" },
     };
 
-    std::exception_ptr ep;
-    try { args.parse(argc, argv); }
-    catch (...) { ep = std::current_exception(); }
+    auto err = args.try_parse(argc, argv);
 
     if (args["--help"])
         show_usage(args, name);
@@ -44,8 +42,8 @@ try
     else if (args["--version"])
         show_version(name);
 
-    else if (ep)
-        std::rethrow_exception(ep);
+    else if (err)
+        err.raise();
 
     else // normal program flow
     {
@@ -61,7 +59,7 @@ try
             "options '-l' and '-L' are mutually exclusive"
         };
 
-        auto chmod = args["--chmod"].value_or("0644");
+        std::string chmod = args["--chmod"].value_or("0644");
 
         std::vector<std::string> rules;
         for (auto const& rule : args["--filter"].values()) rules.push_back(rule);
@@ -0,0 +1,224 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "pgm/args.hpp"
+
+#include <array>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// count heap allocations
+static std::size_t allocs = 0;
+
+void* operator new(std::size_t size)
+{
+    ++allocs;
+    if (auto p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc{};
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept
+{
+    ++allocs;
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::nothrow_t const&) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+//! @brief count allocations made during its lifetime
+struct alloc_count
+{
+    std::size_t start = allocs;
+    auto operator()() const { return allocs - start; }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+struct argcv
+{
+    template<typename... Args>
+    argcv(Args&&... args) : args_{std::forward<Args>(args)...}
+    {
+        for (auto& arg : args_) argcv_.push_back(arg.data());
+        argcv_.push_back(nullptr);
+    }
+
+    auto argc() { return argcv_.size() - 1; }
+    auto argv() { return argcv_.data(); }
+
+private:
+    std::vector<std::string> args_;
+    std::vector<char*> argcv_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// token queues used by parse()
+constexpr std::size_t parse_overhead = 4;
+
+struct alloc_0 : testing::Test
+{
+    pgm::args args
+    {
+        { "-v", "--verbose", pgm::mul, "" },
+        { "-f", "--filter", "RULES", pgm::mul, "" },
+        { "-j", "--jobs", "N", "" },
+        { "-q", "--quiet", "" },
+        { "SRC", pgm::mul, "" },
+        { "DEST", "" },
+    };
+
+    // 10 values stored in 6 argvals
+    argcv p{"pgm", "-v", "--verbose", "--filter=a", "-f", "b", "-j8", "-q", "s1", "s2", "s3", "d"};
+    std::size_t values = 10;
+};
+
+TEST_F(alloc_0, lookup)
+{
+    auto id = args.add("--extra", "");
+    args.parse(p.argc(), p.argv());
+
+    alloc_count count;
+    EXPECT_TRUE(args["--verbose"]);
+    EXPECT_TRUE(args["-f"]);
+    EXPECT_TRUE(args["SRC"]);
+    EXPECT_TRUE(args[id].empty());
+    EXPECT_EQ(args["-v"].value_or("none"), "");
+    EXPECT_EQ(count(), 0);
+}
+
+TEST_F(alloc_0, complete)
+{
+    alloc_count count;
+    auto names = args.complete("--");
+    EXPECT_EQ(names.size(), 4);
+    EXPECT_EQ(*names.begin(), "--filter");
+    EXPECT_EQ(count(), 0);
+}
+
+TEST_F(alloc_0, parse)
+{
+    alloc_count count;
+    args.parse(p.argc(), p.argv());
+    EXPECT_LE(count(), values + parse_overhead);
+}
+
+TEST_F(alloc_0, short_group)
+{
+    auto g = argcv{"pgm", "-vvvvvvvvqj8", "s", "d"};
+
+    alloc_count count;
+    args.parse(g.argc(), g.argv());
+    EXPECT_EQ(args["-v"].count(), 8);
+    EXPECT_LE(count(), 12 + parse_overhead);
+}
+
+TEST_F(alloc_0, error)
+{
+    auto e = argcv{"pgm", "-v", "--filter=a", "-x", "s", "d"};
+    pgm::parse_result res;
+    args.try_parse(e.argc(), e.argv(), res);
+    res.reset();
+
+    alloc_count count;
+    auto err = args.try_parse(e.argc(), e.argv(), res);
+    EXPECT_EQ(err.kind, pgm::parse_errc::unrecognized_option);
+    EXPECT_LE(count(), parse_overhead);
+}
+
+TEST_F(alloc_0, store)
+{
+    int verbose = 0, jobs = 0;
+    args.store("-v", &verbose);
+    args.store("-j", &jobs);
+
+    auto g = argcv{"pgm", "-vvvvvvvv", "-j8", "s", "d"};
+
+    alloc_count count;
+    args.parse(g.argc(), g.argv());
+    EXPECT_EQ(verbose, 8);
+    EXPECT_EQ(jobs, 8);
+    EXPECT_LE(count(), 2 + parse_overhead); // only the params are stored
+}
+
+TEST_F(alloc_0, resource)
+{
+    std::array<std::byte, 16384> buf;
+    std::pmr::monotonic_buffer_resource mr{buf.data(), buf.size(), std::pmr::null_memory_resource()};
+    pgm::parse_result res{&mr};
+
+    alloc_count count;
+    args.parse(p.argc(), p.argv(), res);
+    args.parse(R"(-f "quoted rule" s d)", res);
+    EXPECT_EQ(res["-f"].count(), 3);
+    EXPECT_EQ(res["-f"].value(2), "quoted rule");
+    EXPECT_EQ(count(), 0);
+}
+
+TEST_F(alloc_0, reparse)
+{
+    args.parse(p.argc(), p.argv());
+    args.reset();
+
+    alloc_count count;
+    args.parse(p.argc(), p.argv());
+    EXPECT_LE(count(), parse_overhead);
+}
+
+TEST_F(alloc_0, result)
+{
+    pgm::parse_result res;
+    args.parse(p.argc(), p.argv(), res);
+    res.reset();
+
+    alloc_count count;
+    args.parse(p.argc(), p.argv(), res);
+    EXPECT_TRUE(res["--quiet"]);
+    EXPECT_LE(count(), parse_overhead);
+}
+
+TEST_F(alloc_0, convert)
+{
+    args.parse(p.argc(), p.argv());
+    {
+        alloc_count count;
+        EXPECT_EQ(args["-j"].as<int>(), 8);
+        EXPECT_LE(count(), 2); // converted values + cache
+    }
+    {
+        alloc_count count;
+        EXPECT_EQ(args["-j"].as<int>(), 8);
+        EXPECT_EQ(count(), 0);
+    }
+}
+
+TEST(alloc_1, parallel)
+{
+    pgm::args args{ { "SRC", pgm::mul, "" } };
+
+    std::vector<std::string> words;
+    for (auto n = 0; n < 4096; ++n) words.push_back(std::to_string(n));
+    std::vector<char*> argv;
+    for (auto& w : words) argv.push_back(w.data());
+
+    pgm::parse_result res;
+    args.parse(argv.data(), argv.data() + argv.size(), res);
+    {
+        alloc_count count;
+        EXPECT_EQ(res["SRC"].values_as<int>().size(), 4096);
+        EXPECT_LE(count(), 2); // converted values + cache
+    }
+
+    // re-binds the result, which now converts in chunks
+    args.parallel("SRC", 1);
+    res.reset();
+    args.parse(argv.data(), argv.data() + argv.size(), res);
+    {
+        alloc_count count;
+        EXPECT_EQ(res["SRC"].values_as<int>().size(), 4096);
+        EXPECT_GT(count(), 2); // + errors of each chunk
+    }
+}
@@ -1,10 +1,18 @@
 ////////////////////////////////////////////////////////////////////////////////
 #include "pgm/args.hpp"
 
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include <sys/stat.h> // mkfifo
+
 struct argcv
 {
     template<typename... Args>
@@ -191,3 +199,1556 @@ TEST_F(params_1, mul_3)
     EXPECT_EQ(args["p4"].value( ), "p4");
     EXPECT_EQ(args["p5"].value( ), "p5");
 }
+
+////////////////////////////////////////////////////////////////////////////////
+struct options_0 : testing::Test
+{
+    pgm::args args
+    {
+        { "-a", "" },
+        { "-b", "--bravo", "" },
+        { "-c", "--charlie", "value", pgm::mul, "" },
+        {       "--delta", "value", pgm::optval, "" },
+    };
+};
+
+TEST_F(options_0, zero_copy)
+{
+    auto p = argcv{"pgm", "-cfoo", "--charlie=bar", "-c", "baz", "--delta"};
+
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_EQ(args["-c"].count( ), 3);
+    EXPECT_EQ(args["-c"].value(0), "foo");
+    EXPECT_EQ(args["-c"].value(1), "bar");
+    EXPECT_EQ(args["-c"].value(2), "baz");
+    EXPECT_EQ(args["-c"].value(0).data(), p.argv()[1] + 2);
+    EXPECT_EQ(args["-c"].value(1).data(), p.argv()[2] + 10);
+    EXPECT_EQ(args["-c"].value(2).data(), p.argv()[4]);
+    EXPECT_EQ(args["--delta"].value( ), "");
+}
+
+TEST_F(options_0, string_compat)
+{
+    auto p = argcv{"pgm", "-cfoo", "-c", "bar"};
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+
+    std::string value = args["-c"].value();
+    EXPECT_EQ(value, "foo");
+
+    std::vector<std::string> values;
+    for (auto const& val : args["-c"].values()) values.push_back(val);
+    EXPECT_EQ(values, (std::vector<std::string>{"foo", "bar"}));
+
+    std::string def = args["--delta"].value_or("none");
+    EXPECT_EQ(def, "none");
+}
+
+TEST_F(options_0, short_group)
+{
+    auto p = argcv{"pgm", "-abcfoo"};
+
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_TRUE(args["-a"]);
+    EXPECT_TRUE(args["--bravo"]);
+    EXPECT_EQ  (args["-c"].value(), "foo");
+    EXPECT_TRUE(args["--delta"].empty());
+}
+
+TEST_F(options_0, short_group_long)
+{
+    args.add("-v", pgm::mul, "");
+    auto p = argcv{"pgm", "-vvvvavvvvcfoo", "-vc", "bar"};
+
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_EQ(args["-v"].count(), 9);
+    EXPECT_TRUE(args["-a"]);
+    EXPECT_EQ(args["-c"].count(), 2);
+    EXPECT_EQ(args["-c"].value(0), "foo");
+    EXPECT_EQ(args["-c"].value(0).data(), p.argv()[1] + 11);
+    EXPECT_EQ(args["-c"].value(1), "bar");
+
+    auto e = argcv{"pgm", "-vxa"};
+    args.reset();
+    EXPECT_THROW(args.parse(e.argc(), e.argv()), pgm::invalid_argument);
+}
+
+TEST(options_1, lookup)
+{
+    pgm::args args;
+    for (auto n = 0; n < 300; ++n) args.add("--opt-" + std::to_string(n), "");
+    args.add("-x", "--extra", "");
+
+    EXPECT_THROW(args.add("--opt-42", ""), pgm::invalid_definition);
+    EXPECT_THROW(args.add("-x", ""), pgm::invalid_definition);
+    EXPECT_THROW(args.add("-y", "--extra", ""), pgm::invalid_definition);
+    EXPECT_THROW(args["--opt-300"], pgm::invalid_argument);
+
+    auto p = argcv{"pgm", "--opt-7", "--opt-299", "-x"};
+
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_TRUE(args["--opt-7"]);
+    EXPECT_TRUE(args["--opt-299"]);
+    EXPECT_TRUE(args["--extra"]);
+    EXPECT_TRUE(args["--opt-8"].empty());
+}
+
+TEST(options_2, handles)
+{
+    pgm::args args;
+    auto a = args.add("-a", pgm::mul, "");
+    auto b = args.add("-b", "--bravo", "value", "");
+    auto p1 = args.add("p1", "");
+
+    auto p = argcv{"pgm", "-aa", "--bravo=foo", "bar"};
+
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_EQ(args[a].count(), 2);
+    EXPECT_EQ(args[b].value(), "foo");
+    EXPECT_EQ(args[p1].value(), "bar");
+    EXPECT_EQ(&args[b], &args["-b"]);
+}
+
+TEST(options_3, copy)
+{
+    std::optional<pgm::args> orig{std::in_place, std::initializer_list<pgm::arg>{
+        { "-o", "--output", "FILE", "write to FILE" },
+        {       "--color", "WHEN", pgm::optval, "" },
+    }};
+    for (auto n = 0; n < 100; ++n) orig->add("--opt-" + std::to_string(n), ""); // grow the string pool
+
+    auto args = *orig;
+    auto text = orig->usage("pgm");
+    orig.reset();
+
+    EXPECT_EQ(args.usage("pgm"), text);
+    EXPECT_NE(text.find("-o, --output=<FILE>    write to FILE"), text.npos);
+    EXPECT_NE(text.find("    --color=[WHEN]"), text.npos);
+
+    auto p = argcv{"pgm", "--out", "foo", "--opt-99"};
+    EXPECT_EQ(args.try_parse(p.argc(), p.argv()).kind, pgm::parse_errc::unrecognized_option);
+
+    args.reset();
+    auto p2 = argcv{"pgm", "-o", "foo", "--opt-99"};
+    EXPECT_NO_THROW({ args.parse(p2.argc(), p2.argv()); });
+    EXPECT_EQ(args["--output"].value(), "foo");
+    EXPECT_TRUE(args["--opt-99"]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+constexpr pgm::static_args schema_0
+{{
+    { "-a", pgm::mul, "" },
+    { "-b", "--bravo", "value", "" },
+    {       "--charlie", "" },
+    { "p1", pgm::opt, "" },
+    { "p2", "" },
+}};
+
+TEST(static_args_0, parse)
+{
+    pgm::args args{schema_0};
+    auto d = args.add("-d", "--delta", "");
+
+    EXPECT_THROW(args.add("--charlie", ""), pgm::invalid_definition);
+    EXPECT_THROW(args.add("p2", ""), pgm::invalid_definition);
+
+    auto p = argcv{"pgm", "-aa", "--bravo=foo", "-d", "bar"};
+
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_EQ  (args["-a"].count(), 2);
+    EXPECT_EQ  (args["-b"].value(), "foo");
+    EXPECT_TRUE(args["--charlie"].empty());
+    EXPECT_TRUE(args[d]);
+    EXPECT_TRUE(args["p1"].empty());
+    EXPECT_EQ  (args["p2"].value(), "bar");
+}
+
+TEST(static_args_0, invalid)
+{
+    using sa = pgm::static_args<2>;
+    EXPECT_THROW((sa{{ { "-a", "" }, { "-a", "--alpha", "" } }}), pgm::invalid_definition);
+    EXPECT_THROW((sa{{ { "p1", "" }, { "p1", "" } }}), pgm::invalid_definition);
+    EXPECT_THROW((sa{{ { "-a", "" }, { "-ab", "" } }}), pgm::invalid_definition);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct values_0 : testing::Test
+{
+    pgm::args args
+    {
+        { "-j", "--jobs", "N", "" },
+        { "-r", "--ratio", "R", "" },
+        { "-t", "--timeout", "T", pgm::mul, "" },
+        { "-f", "--flag", "F", pgm::optval, "" },
+        { "nums", pgm::opt | pgm::mul, "" },
+    };
+};
+
+TEST_F(values_0, as)
+{
+    using namespace std::chrono_literals;
+    auto p = argcv{"pgm", "-j", "8", "--ratio=0.25", "-t5", "-t", "250ms", "-t2m", "--flag=off", "--", "1", "-2", "3"};
+
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_EQ(args["-j"].as<int>(), 8);
+    EXPECT_EQ(args["-r"].as<double>(), 0.25);
+    EXPECT_EQ(args["-t"].as<std::chrono::milliseconds>(0), 5ms);
+    EXPECT_EQ(args["-t"].as<std::chrono::milliseconds>(1), 250ms);
+    EXPECT_EQ(args["-t"].as<std::chrono::milliseconds>(2), 120000ms);
+    EXPECT_EQ(args["-f"].as<bool>(), false);
+    EXPECT_EQ(args["nums"].values_as<int>(), (std::vector<int>{1, -2, 3}));
+    EXPECT_EQ(&args["nums"].values_as<int>(), &args["nums"].values_as<int>());
+}
+
+TEST_F(values_0, cache)
+{
+    auto p = argcv{"pgm", "--", "1", "-2", "3"};
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+
+    auto& ints = args["nums"].values_as<int>();
+    EXPECT_EQ(args["nums"].as<long>(2), 3L);
+    EXPECT_EQ(args["nums"].as<double>(1), -2.0);
+    EXPECT_EQ(ints, (std::vector<int>{1, -2, 3})); // still valid
+    EXPECT_EQ(&ints, &args["nums"].values_as<int>());
+
+    // concurrent conversion
+    std::vector<std::thread> threads;
+    std::vector<std::vector<short> const*> vals(8);
+    for (std::size_t n = 0; n < vals.size(); ++n)
+        threads.emplace_back([&, n]{ vals[n] = &args["nums"].values_as<short>(); });
+    for (auto&& th : threads) th.join();
+
+    for (auto val : vals) EXPECT_EQ(val, vals[0]);
+    EXPECT_EQ(*vals[0], (std::vector<short>{1, -2, 3}));
+
+    // values added without a reset keep the cache (and references into it)
+    auto& times = args["-t"].values_as<int>();
+    EXPECT_NO_THROW({ args.parse("-t 5"); });
+    EXPECT_TRUE(times.empty());
+    EXPECT_EQ(&times, &args["-t"].values_as<int>());
+
+    args.reset();
+    EXPECT_TRUE(args["nums"].values_as<int>().empty());
+}
+
+TEST_F(values_0, as_or)
+{
+    auto p = argcv{"pgm", "-f"};
+
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_EQ(args["-j"].as_or(4), 4);
+    EXPECT_EQ(args["-f"].as<bool>(), true);
+    EXPECT_THROW(args["-j"].as<int>(), std::out_of_range);
+}
+
+TEST_F(values_0, bad_value)
+{
+    auto p = argcv{"pgm", "-j8x", "-r", "1e999", "-t", "5d", "--", "-"};
+
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_THROW(args["-j"].as<int>(), pgm::invalid_argument);
+    EXPECT_THROW(args["-r"].as<double>(), pgm::invalid_argument);
+    EXPECT_THROW(args["-t"].as<std::chrono::seconds>(), pgm::invalid_argument);
+    EXPECT_THROW(args["nums"].as<int>(), pgm::invalid_argument);
+    EXPECT_THROW(args["nums"].as<unsigned char>(), pgm::invalid_argument);
+
+    try { args["-j"].as<int>(); }
+    catch (pgm::invalid_argument& e) { EXPECT_STREQ(e.what(), "Invalid argument: bad value '8x' for '--jobs'."); }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct response_0 : testing::Test
+{
+    pgm::args args
+    {
+        { "-a", pgm::mul, "" },
+        { "-b", "--bravo", "value", "" },
+        { "files", pgm::opt | pgm::mul, "" },
+    };
+
+    std::string write(std::string const& name, std::string const& data)
+    {
+        auto path = testing::TempDir() + name;
+        std::ofstream{path, std::ios::binary} << data;
+        return path;
+    }
+};
+
+TEST_F(response_0, lines)
+{
+    args.response_files(pgm::response::lines);
+
+    auto path = write("lines.rsp", std::string{"-a\r\n--bravo\n\nfoo bar\0baz", 24});
+    auto p = argcv{"pgm", "@" + path, "qux"};
+
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_EQ(args["-a"].count(), 1);
+    EXPECT_EQ(args["-b"].value(), "foo bar");
+    EXPECT_EQ(args["files"].values(), (std::pmr::vector<pgm::value_view>{"baz", "qux"}));
+}
+
+TEST_F(response_0, shell)
+{
+    args.response_files(pgm::response::shell);
+
+    auto inner = write("inner.rsp", R"(-aa "x y" 'a "b" c' d\ e "\"f\\g\h")");
+    auto outer = write("outer.rsp", "--bravo=\"1  2\"\n@" + inner + "\n-- @" + inner);
+    auto p = argcv{"pgm", "@" + outer};
+
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_EQ(args["-a"].count(), 2);
+    EXPECT_EQ(args["-b"].value(), "1  2");
+    EXPECT_EQ(args["files"].values(), (std::pmr::vector<pgm::value_view>{
+        "x y", "a \"b\" c", "d e", "\"f\\g\\h", "@" + inner
+    }));
+}
+
+TEST_F(response_0, fifo)
+{
+    args.response_files(pgm::response::lines);
+
+    // FIFOs report size 0 and must be read rather than mapped
+    auto path = testing::TempDir() + "fifo.rsp";
+    std::remove(path.data());
+    ASSERT_EQ(::mkfifo(path.data(), 0600), 0);
+
+    std::thread writer{[&]{ std::ofstream{path, std::ios::binary} << "-a\n--bravo\nfoo\nbar\n"; }};
+    auto p = argcv{"pgm", "@" + path};
+
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    writer.join();
+    std::remove(path.data());
+
+    EXPECT_EQ(args["-a"].count(), 1);
+    EXPECT_EQ(args["-b"].value(), "foo");
+    EXPECT_EQ(args["files"].values(), (std::pmr::vector<pgm::value_view>{"bar"}));
+}
+
+TEST_F(response_0, errors)
+{
+    args.response_files(pgm::response::shell, 4);
+
+    auto self = testing::TempDir() + "self.rsp";
+    write("self.rsp", "-a @" + self);
+    auto bad = write("bad.rsp", "\"foo");
+
+    auto p0 = argcv{"pgm", "@" + self};
+    EXPECT_THROW({ args.parse(p0.argc(), p0.argv()); }, pgm::invalid_argument);
+
+    auto p1 = argcv{"pgm", "@" + bad};
+    EXPECT_THROW({ args.parse(p1.argc(), p1.argv()); }, pgm::invalid_argument);
+
+    auto p2 = argcv{"pgm", "@" + testing::TempDir() + "missing.rsp"};
+    EXPECT_THROW({ args.parse(p2.argc(), p2.argv()); }, pgm::invalid_argument);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct stream_0 : testing::Test
+{
+    pgm::args args
+    {
+        { "-a", "" },
+        { "p1", pgm::opt, "" },
+        { "p2", "" },
+        { "p3", pgm::mul, "" },
+        { "p4", pgm::opt, "" },
+        { "p5", "" },
+    };
+
+    std::vector<std::string_view> values;
+    void SetUp() override { args.stream("p3", [&](auto v){ values.push_back(v); }); }
+};
+
+TEST_F(stream_0, munch)
+{
+    auto p = argcv{"pgm", "1", "2", "3.0", "3.1", "-a", "3.2", "3.3", "4", "5"};
+
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_EQ  (values, (std::vector<std::string_view>{"3.0", "3.1", "3.2", "3.3"}));
+    EXPECT_EQ  (args["p1"].value(), "1");
+    EXPECT_EQ  (args["p2"].value(), "2");
+    EXPECT_TRUE(args["p3"].empty());
+    EXPECT_EQ  (args["p4"].value(), "4");
+    EXPECT_EQ  (args["p5"].value(), "5");
+}
+
+TEST_F(stream_0, early)
+{
+    auto p = argcv{"pgm", "1", "2", "3.0", "3.1", "3.2", "4", "5", "--bad"};
+
+    EXPECT_THROW({ args.parse(p.argc(), p.argv()); }, pgm::invalid_argument);
+    EXPECT_EQ(values, (std::vector<std::string_view>{"3.0", "3.1"}));
+}
+
+TEST_F(stream_0, short_)
+{
+    auto p = argcv{"pgm", "2", "3.0", "5"};
+
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_EQ  (values, (std::vector<std::string_view>{"3.0"}));
+    EXPECT_TRUE(args["p1"].empty());
+    EXPECT_EQ  (args["p2"].value(), "2");
+    EXPECT_TRUE(args["p4"].empty());
+    EXPECT_EQ  (args["p5"].value(), "5");
+}
+
+TEST_F(stream_0, invalid)
+{
+    EXPECT_THROW(args.stream("p1", [](auto){ }), pgm::invalid_definition);
+    EXPECT_THROW(args.stream("p6", [](auto){ }), pgm::invalid_definition);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(result_0, shared)
+{
+    pgm::args const args
+    {
+        { "-a", pgm::mul, "" },
+        { "-b", "--bravo", "value", "" },
+        { "p1", pgm::opt, "" },
+    };
+
+    EXPECT_TRUE(args["-a"].empty());
+    EXPECT_THROW(args["-c"], pgm::invalid_argument);
+
+    auto p0 = argcv{"pgm", "-aa", "foo"};
+    auto p1 = argcv{"pgm", "--bravo=bar"};
+
+    pgm::parse_result r0, r1;
+    EXPECT_NO_THROW({ args.parse(p0.argc(), p0.argv(), r0); });
+    EXPECT_NO_THROW({ args.parse(p1.argc(), p1.argv(), r1); });
+
+    EXPECT_EQ  (r0["-a"].count(), 2);
+    EXPECT_TRUE(r0["-b"].empty());
+    EXPECT_EQ  (r0["p1"].value(), "foo");
+
+    EXPECT_TRUE(r1["-a"].empty());
+    EXPECT_EQ  (r1["-b"].value(), "bar");
+    EXPECT_TRUE(r1["p1"].empty());
+
+    EXPECT_TRUE(args["-a"].empty());
+    EXPECT_THROW(r0["-c"], pgm::invalid_argument);
+    EXPECT_THROW(pgm::parse_result{}["-a"], pgm::invalid_argument);
+}
+
+TEST(result_0, reset)
+{
+    pgm::args args
+    {
+        { "-a", "" },
+        { "-b", "--bravo", "value", "" },
+        { "p1", pgm::opt | pgm::mul, "" },
+    };
+
+    auto p0 = argcv{"pgm", "-ab1", "foo", "bar"};
+    auto p1 = argcv{"pgm", "-b", "2", "baz"};
+
+    EXPECT_NO_THROW({ args.parse(p0.argc(), p0.argv()); });
+    EXPECT_EQ(args["-b"].as<int>(), 1);
+    EXPECT_EQ(args["p1"].count(), 2);
+
+    auto data = args["p1"].values().data();
+    EXPECT_THROW({ args.parse(p1.argc(), p1.argv()); }, pgm::invalid_argument);
+
+    args.reset();
+    EXPECT_TRUE(args["-a"].empty());
+    EXPECT_TRUE(args["-b"].empty());
+
+    EXPECT_NO_THROW({ args.parse(p1.argc(), p1.argv()); });
+    EXPECT_TRUE(args["-a"].empty());
+    EXPECT_EQ  (args["-b"].as<int>(), 2);
+    EXPECT_EQ  (args["p1"].values(), (std::pmr::vector<pgm::value_view>{"baz"}));
+    EXPECT_EQ  (args["p1"].values().data(), data);
+}
+
+TEST(result_0, copy)
+{
+    std::optional<pgm::args> orig{std::in_place, std::initializer_list<pgm::arg>{
+        { "-j", "--jobs", "N", "" },
+        { "files", pgm::mul, "" },
+    }};
+    EXPECT_NO_THROW({ orig->parse(R"(--jobs "8x" 'a b' "c")"); }); // quoted words are kept in the result
+
+    auto args = *orig;
+    pgm::parse_result res;
+    EXPECT_NO_THROW({ args.parse(R"(-j '4' 'd e')", res); });
+    orig.reset();
+
+    EXPECT_EQ(args["files"].values(), (std::pmr::vector<pgm::value_view>{"a b", "c"}));
+    try { args["--jobs"].as<int>(); FAIL(); }
+    catch (pgm::invalid_argument& e) { EXPECT_STREQ(e.what(), "Invalid argument: bad value '8x' for '--jobs'."); }
+
+    std::optional<pgm::parse_result> copy{res};
+    res = { };
+    EXPECT_EQ((*copy)["-j"].as<int>(), 4);
+    EXPECT_EQ((*copy)["files"].values(), (std::pmr::vector<pgm::value_view>{"d e"}));
+
+    res = *copy;
+    copy.reset();
+    EXPECT_EQ(res["files"].values(), (std::pmr::vector<pgm::value_view>{"d e"}));
+
+    auto moved = std::move(args);
+    EXPECT_EQ(moved["files"].values(), (std::pmr::vector<pgm::value_view>{"a b", "c"}));
+    EXPECT_THROW(moved["-j"].as<int>(), pgm::invalid_argument);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct cmdline_0 : testing::Test
+{
+    pgm::args args
+    {
+        { "-r", "" },
+        { "-f", "--filter", "rules", pgm::mul, "" },
+        { "files", pgm::mul, "" },
+    };
+};
+
+TEST_F(cmdline_0, string)
+{
+    std::string_view cmdline = R"(  -r --filter=*.log	-f "a b" a\ b 'c "d"' e )";
+
+    EXPECT_NO_THROW({ args.parse(cmdline); });
+    EXPECT_TRUE(args["-r"]);
+    EXPECT_EQ(args["-f"].values(), (std::pmr::vector<pgm::value_view>{"*.log", "a b"}));
+    EXPECT_EQ(args["files"].values(), (std::pmr::vector<pgm::value_view>{"a b", "c \"d\"", "e"}));
+
+    auto p = cmdline.data();
+    EXPECT_TRUE(args["-f"].value(0).data() > p && args["-f"].value(0).data() < p + cmdline.size());
+    EXPECT_EQ(args["files"].value(2).data(), p + cmdline.size() - 2);
+}
+
+TEST_F(cmdline_0, unterminated)
+{
+    EXPECT_THROW({ args.parse("-r 'foo"); }, pgm::invalid_argument);
+}
+
+TEST_F(cmdline_0, range)
+{
+    std::vector<std::string_view> v{ "-rf", "rule", "--", "-a", "b" };
+
+    pgm::parse_result res;
+    EXPECT_NO_THROW({ args.parse(v.begin(), v.end(), res); });
+    EXPECT_TRUE(res["-r"]);
+    EXPECT_EQ(res["-f"].value(), "rule");
+    EXPECT_EQ(res["files"].values(), (std::pmr::vector<pgm::value_view>{"-a", "b"}));
+    EXPECT_EQ(res["files"].value(1).data(), v[4].data());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(usage_0, format)
+{
+    pgm::args args
+    {
+        { "-v", "--verbose", "be verbose\nreally" },
+        {       "--jobs", "N", pgm::optval, "" },
+        { "SRC", "" },
+    };
+
+    EXPECT_EQ(args.usage("pgm"),
+        "Usage: pgm [option]... <SRC>\n"
+        "              \n"
+        "Options:      \n"
+        "-v, --verbose     be verbose\n"
+        "                  really\n"
+        "    --jobs=[N]\n"
+        "              \n"
+        "Parameters:   \n"
+        "SRC           "
+    );
+
+    args.add("--a-very-long-option-name-to-widen-the-column", "long");
+    auto text = args.usage("pgm", "preamble", { }, "epilogue");
+    EXPECT_NE(text.find("\n    --a-very-long-option-name-to-widen-the-column    long\n"), text.npos);
+    EXPECT_NE(text.find("\n-v, --verbose" + std::string(40, ' ') + "be verbose\n"), text.npos);
+
+    std::ostringstream os;
+    args.usage(os, "pgm", "preamble", { }, "epilogue");
+    EXPECT_EQ(os.str(), text);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct error_0 : testing::Test
+{
+    pgm::args args
+    {
+        { "-a", "" },
+        { "-b", "--bravo", "value", "" },
+        { "-c", "--charlie", pgm::req, "" },
+        { "SRC", "" },
+    };
+};
+
+TEST_F(error_0, kinds)
+{
+    auto p = argcv{"pgm", "-c", "-ax", "src"};
+    auto err = args.try_parse(p.argc(), p.argv());
+    EXPECT_EQ(err.kind, pgm::parse_errc::unrecognized_option);
+    EXPECT_EQ(err.token, 1);
+    EXPECT_EQ(err.text, "x");
+    EXPECT_TRUE(err.short_name);
+    EXPECT_EQ(err.text.data(), p.argv()[2] + 2);
+    EXPECT_EQ(err.message(), "Invalid argument: unrecognized option '-x'.");
+
+    pgm::parse_result res;
+    EXPECT_EQ(args.try_parse("-c --charlie=foo src", res).kind, pgm::parse_errc::unexpected_value);
+
+    res.reset();
+    err = args.try_parse("-c src -b", res);
+    EXPECT_EQ(err.kind, pgm::parse_errc::missing_value);
+    EXPECT_EQ(err.token, 2);
+    EXPECT_EQ(err.slot, 1);
+    EXPECT_EQ(err.message(), "Missing argument: '-b' requires a value.");
+
+    args.reset();
+    err = args.try_parse("src");
+    EXPECT_EQ(err.kind, pgm::parse_errc::missing_option);
+    EXPECT_EQ(err.token, pgm::parse_error::npos);
+    EXPECT_EQ(err.slot, 2);
+    EXPECT_EQ(err.message(), "Missing argument: option '-c, --charlie' is required.");
+
+    args.reset();
+    err = args.try_parse("-c src dest");
+    EXPECT_EQ(err.kind, pgm::parse_errc::extra_param);
+    EXPECT_EQ(err.token, 2);
+    EXPECT_EQ(err.text, "dest");
+
+    args.reset();
+    err = args.try_parse("-c");
+    EXPECT_EQ(err.kind, pgm::parse_errc::missing_param);
+    EXPECT_EQ(err.slot, 0);
+
+    args.reset();
+    EXPECT_EQ(args.try_parse("-c --bravo 'foo").kind, pgm::parse_errc::unterminated_quote);
+
+    args.reset();
+    err = args.try_parse("-cc src");
+    EXPECT_EQ(err.kind, pgm::parse_errc::duplicate_option);
+    EXPECT_EQ(err.message(), "Invalid argument: duplicate option '-c'.");
+}
+
+TEST(error_1, long_char)
+{
+    pgm::args args{ { "-x", "--y", "" } };
+
+    auto err = args.try_parse("--y --y");
+    EXPECT_EQ(err.kind, pgm::parse_errc::duplicate_option);
+    EXPECT_FALSE(err.short_name);
+    EXPECT_EQ(err.message(), "Invalid argument: duplicate option '--y'.");
+
+    args.reset();
+    EXPECT_EQ(args.try_parse("-xx").message(), "Invalid argument: duplicate option '-x'.");
+}
+
+TEST_F(error_0, none)
+{
+    auto err = args.try_parse("-a --charlie src");
+    EXPECT_FALSE(err);
+    EXPECT_EQ(err.kind, pgm::parse_errc::none);
+    EXPECT_TRUE(args["-a"]);
+    EXPECT_EQ(args["SRC"].value(), "src");
+}
+
+TEST_F(error_0, raise)
+{
+    auto err = args.try_parse("-c --foo src");
+    ASSERT_TRUE(err);
+    EXPECT_THROW(err.raise(), pgm::invalid_argument);
+
+    try { err.raise(); }
+    catch (pgm::invalid_argument& e) { EXPECT_EQ(err.message(), e.what()); }
+
+    args.reset();
+    EXPECT_THROW(args.try_parse("-c").raise(), pgm::missing_argument);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(stop_0, help)
+{
+    pgm::args args
+    {
+        { "-v", "--verbose", "" },
+        { "-c", pgm::req, "" },
+        { "SRC", "" },
+    };
+    auto help = args.add("-h", "--help", pgm::stop, "");
+
+    auto p = argcv{"pgm", "-v", "--help", "--foo", "a", "b", "c"};
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    ASSERT_TRUE(args.stopped());
+    EXPECT_TRUE(*args.stopped() == help);
+    EXPECT_TRUE(args["-v"]);
+    EXPECT_TRUE(args["-h"]);
+    EXPECT_TRUE(args["SRC"].empty());
+
+    args.reset();
+    EXPECT_FALSE(args.stopped());
+
+    // rest of a short group is skipped too
+    p = argcv{"pgm", "-hx"};
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_TRUE(args.stopped());
+
+    args.reset();
+    EXPECT_THROW(args.parse("-v"), pgm::missing_argument);
+    EXPECT_FALSE(args.stopped());
+
+    pgm::parse_result res;
+    EXPECT_FALSE(args.try_parse("-v --help -x", res));
+    EXPECT_TRUE(res.stopped());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct command_0 : testing::Test
+{
+    int made = 0;
+    pgm::args args
+    {
+        { "-v", "--verbose", pgm::mul, "" },
+        { "-C", "DIR", "" },
+    };
+
+    void SetUp() override
+    {
+        args.add_command("clone", "clone a repository", [&]{
+            ++made;
+            return pgm::args{
+                { "-b", "--branch", "NAME", "" },
+                { "REPO", "" },
+                { "DIR", pgm::opt, "" },
+            };
+        });
+        args.add_command("status", "show the working tree status", [&]{
+            ++made;
+            return pgm::args{ { "-s", "--short", "" } };
+        });
+    }
+};
+
+TEST_F(command_0, parse)
+{
+    auto p = argcv{"pgm", "-v", "-C", "src", "clone", "-b", "main", "url"};
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_EQ(made, 1);
+    EXPECT_TRUE(args["-v"]);
+    EXPECT_EQ(args["-C"].value(), "src");
+    EXPECT_EQ(args.command(), "clone");
+    EXPECT_EQ(args.command_args()["--branch"].value(), "main");
+    EXPECT_EQ(args.command_args()["REPO"].value(), "url");
+    EXPECT_TRUE(args.command_args()["DIR"].empty());
+
+    // same subcommand is reused
+    args.reset();
+    EXPECT_TRUE(args.command().empty());
+    EXPECT_NO_THROW({ args.parse("clone other"); });
+    EXPECT_EQ(made, 1);
+    EXPECT_EQ(args.command_args()["REPO"].value(), "other");
+    EXPECT_TRUE(args.command_args()["-b"].empty());
+
+    args.reset();
+    EXPECT_NO_THROW({ args.parse("-vv status -s"); });
+    EXPECT_EQ(made, 2);
+    EXPECT_EQ(args["-v"].count(), 2);
+    EXPECT_TRUE(args.command_args()["--short"]);
+}
+
+TEST_F(command_0, copy)
+{
+    EXPECT_NO_THROW({ args.parse(R"(-C "src" clone -b 'main' "url")"); });
+
+    std::optional<pgm::args> copy{args};
+    args.reset();
+    EXPECT_NO_THROW({ args.parse("status"); });
+
+    EXPECT_EQ((*copy)["-C"].value(), "src");
+    EXPECT_EQ(copy->command(), "clone");
+    EXPECT_EQ(copy->command_args()["--branch"].value(), "main");
+    EXPECT_EQ(copy->command_args()["REPO"].value(), "url");
+
+    args = *copy;
+    copy.reset();
+    EXPECT_EQ(args.command(), "clone");
+    EXPECT_EQ(args.command_args()["REPO"].value(), "url");
+}
+
+TEST_F(command_0, errors)
+{
+    EXPECT_THROW(args.parse("-v"), pgm::missing_argument);
+    EXPECT_THROW(args.command_args(), pgm::invalid_argument);
+
+    args.reset();
+    auto err = args.try_parse("-v push");
+    EXPECT_EQ(err.kind, pgm::parse_errc::unrecognized_command);
+    EXPECT_EQ(err.token, 1);
+    EXPECT_EQ(made, 0);
+
+    args.reset();
+    err = args.try_parse("-v status -x");
+    EXPECT_EQ(err.kind, pgm::parse_errc::unrecognized_option);
+    EXPECT_EQ(err.token, 2);
+    EXPECT_EQ(err.message(), "Invalid argument: unrecognized option '-x'.");
+
+    // global options go before the subcommand
+    args.reset();
+    EXPECT_EQ(args.try_parse("status -v").kind, pgm::parse_errc::unrecognized_option);
+
+    EXPECT_THROW(args.add_command("status", "", nullptr), pgm::invalid_definition);
+    EXPECT_THROW(args.add_command("--bad", "", nullptr), pgm::invalid_definition);
+    EXPECT_THROW(args.add("PARAM", ""), pgm::invalid_definition);
+}
+
+TEST_F(command_0, usage)
+{
+    auto text = args.usage("pgm");
+    EXPECT_EQ(text.find("Usage: pgm [option]... <command> [arg]...\n"), 0);
+    EXPECT_NE(text.find("\nCommands:"), text.npos);
+    EXPECT_NE(text.find("\nclone            clone a repository\n"), text.npos);
+    EXPECT_EQ(made, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct store_0 : testing::Test
+{
+    pgm::args args
+    {
+        { "-v", "--verbose", pgm::mul, "" },
+        { "-q", "--quiet", "" },
+        { "-j", "--jobs", "N", "" },
+        { "-I", "DIR", pgm::mul, "" },
+        { "-t", "--timeout", "T", "" },
+        {       "--name", "NAME", "" },
+    };
+
+    int verbose = 0, jobs = 1;
+    bool quiet = false;
+    std::vector<std::string_view> dirs;
+    std::chrono::milliseconds timeout{ };
+    std::string name;
+
+    void SetUp() override
+    {
+        args.store("-v", &verbose);
+        args.store("-q", &quiet);
+        args.store("--jobs", &jobs);
+        args.store("-I", &dirs);
+        args.store("-t", &timeout);
+        args.store("--name", &name);
+    }
+};
+
+TEST_F(store_0, parse)
+{
+    auto p = argcv{"pgm", "-vvq", "-j8", "-Ia", "-I", "b", "--timeout=2s", "--name", "foo", "-v"};
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_EQ(verbose, 3);
+    EXPECT_TRUE(quiet);
+    EXPECT_EQ(jobs, 8);
+    EXPECT_EQ(dirs, (std::vector<std::string_view>{"a", "b"}));
+    EXPECT_EQ(dirs[0].data(), p.argv()[3] + 2);
+    EXPECT_EQ(timeout, std::chrono::seconds{2});
+    EXPECT_EQ(name, "foo");
+
+    // present, but not stored
+    EXPECT_EQ(args["-v"].count(), 3);
+    EXPECT_TRUE(args["-j"]);
+    EXPECT_TRUE(args["-I"].values().empty());
+    EXPECT_THROW(args["-j"].value(), std::out_of_range);
+    EXPECT_EQ(args["-j"].value_or("x"), "x");
+    EXPECT_EQ(args["-j"].as_or(5), 5);
+}
+
+TEST(store_1, config)
+{
+    pgm::args args
+    {
+        { "-v", "--verbose", pgm::mul, "" },
+        { "-j", "--jobs", "N", "" },
+        {       "--include", "DIR", pgm::mul, "" },
+        {       "--name", "NAME", "" },
+    };
+    args.env("--verbose", "TEST_ARGS_STORE_VERBOSE");
+
+    int verbose = 0, jobs = 1;
+    std::vector<std::string_view> dirs;
+    std::string name;
+    args.store("-v", &verbose);
+    args.store("-j", &jobs);
+    args.store("--include", &dirs);
+    args.store("--name", &name);
+
+    auto path = testing::TempDir() + "store_1.conf";
+    std::ofstream{path} << "verbose\njobs = 4\ninclude = fromconf\nname = foo\n";
+
+    // command line replaces config file values
+    EXPECT_NO_THROW({ args.parse_config(path); });
+    EXPECT_EQ(verbose, 0); // not sent yet
+    EXPECT_NO_THROW({ args.parse("-v --include=fromcli"); });
+    EXPECT_EQ(verbose, 1);
+    EXPECT_EQ(args["-v"].count(), 1);
+    EXPECT_EQ(dirs, (std::vector<std::string_view>{"fromcli"}));
+    EXPECT_EQ(jobs, 4);
+    EXPECT_EQ(name, "foo");
+
+    // and so does the environment
+    args.reset();
+    verbose = 0; dirs.clear();
+    ::setenv("TEST_ARGS_STORE_VERBOSE", "1", 1);
+    EXPECT_NO_THROW({ args.parse_config(path); });
+    EXPECT_NO_THROW({ args.parse(""); });
+    EXPECT_EQ(verbose, 1);
+    EXPECT_EQ(dirs, (std::vector<std::string_view>{"fromconf"}));
+    ::unsetenv("TEST_ARGS_STORE_VERBOSE");
+
+    // config files read after parse() send values right away, but not twice
+    args.reset();
+    verbose = 0; jobs = 1; dirs.clear();
+    EXPECT_NO_THROW({ args.parse("-j 2"); });
+    EXPECT_NO_THROW({ args.parse_config(path); });
+    EXPECT_NO_THROW({ args.parse_config(path); });
+    EXPECT_EQ(verbose, 1);
+    EXPECT_EQ(jobs, 2);
+    EXPECT_EQ(dirs, (std::vector<std::string_view>{"fromconf"}));
+
+    // bad values are reported with their location
+    args.reset();
+    std::ofstream{path} << "\njobs = many\n";
+    EXPECT_NO_THROW({ args.parse_config(path); });
+    auto err = args.try_parse("");
+    EXPECT_EQ(err.kind, pgm::parse_errc::bad_value);
+    EXPECT_EQ(err.message(), "Invalid argument: bad value 'many' for '--jobs' in config file '" + path + "', line 2.");
+
+    std::remove(path.data());
+}
+
+TEST_F(store_0, errors)
+{
+    auto err = args.try_parse("-j x");
+    EXPECT_EQ(err.kind, pgm::parse_errc::bad_value);
+    EXPECT_EQ(err.token, 1);
+    EXPECT_EQ(err.text, "x");
+    EXPECT_EQ(err.message(), "Invalid argument: bad value 'x' for '--jobs'.");
+
+    args.reset();
+    err = args.try_parse("--jobs=99999999999");
+    EXPECT_EQ(err.kind, pgm::parse_errc::out_of_range);
+    EXPECT_THROW(err.raise(), pgm::invalid_argument);
+
+    args.reset();
+    EXPECT_THROW(args.parse("-j1 -j2"), pgm::invalid_argument);
+    EXPECT_THROW(args.store("--foo", &jobs), pgm::invalid_definition);
+}
+
+TEST_F(store_0, stream)
+{
+    std::vector<std::string_view> seen;
+    args.stream("-q", [&](auto val){ seen.push_back(val); });
+    args.stream("--name", [&](auto val){ seen.push_back(val); });
+
+    EXPECT_NO_THROW({ args.parse("--name bar -q"); });
+    EXPECT_EQ(seen, (std::vector<std::string_view>{"bar", ""}));
+    EXPECT_TRUE(args["-q"]);
+    EXPECT_FALSE(quiet);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct env_0 : testing::Test
+{
+    pgm::args args
+    {
+        { "-v", "--verbose", "" },
+        { "-q", "--quiet", "" },
+        { "-j", "--jobs", "N", "" },
+        {       "--dry-run", "" },
+        { "-o", "FILE", pgm::req, "" },
+    };
+
+    void SetUp() override
+    {
+        ::setenv("TEST_ARGS_VERBOSE", "yes", 1);
+        ::setenv("TEST_ARGS_QUIET", "0", 1);
+        ::setenv("TEST_ARGS_JOBS", "4", 1);
+        ::setenv("TEST_ARGS_DRY_RUN", "1", 1);
+        ::setenv("TEST_ARGS_OUT", "out.txt", 1);
+    }
+    void TearDown() override
+    {
+        for (auto var : { "TEST_ARGS_VERBOSE", "TEST_ARGS_QUIET", "TEST_ARGS_JOBS", "TEST_ARGS_DRY_RUN", "TEST_ARGS_OUT" })
+            ::unsetenv(var);
+    }
+};
+
+TEST_F(env_0, prefix)
+{
+    args.env_prefix("TEST_ARGS_");
+    args.env("-o", "TEST_ARGS_OUT");
+    args.add("-n", "--name", "NAME", "");
+    ::setenv("TEST_ARGS_NAME", "foo", 1);
+
+    EXPECT_NO_THROW({ args.parse("-j 8"); });
+    EXPECT_TRUE(args["--verbose"]);
+    EXPECT_FALSE(args["--quiet"]);
+    EXPECT_EQ(args["--jobs"].value(), "8"); // command line takes precedence
+    EXPECT_TRUE(args["--dry-run"]);
+    EXPECT_EQ(args["-o"].value(), "out.txt");
+    EXPECT_EQ(args["--name"].value(), "foo");
+    ::unsetenv("TEST_ARGS_NAME");
+}
+
+TEST_F(env_0, store)
+{
+    int jobs = 0;
+    args.store("-j", &jobs);
+    args.env("--jobs", "TEST_ARGS_JOBS");
+
+    EXPECT_THROW(args.parse(""), pgm::missing_argument);
+    EXPECT_EQ(jobs, 4);
+
+    args.reset();
+    ::setenv("TEST_ARGS_JOBS", "four", 1);
+    auto err = args.try_parse("-o x");
+    EXPECT_EQ(err.kind, pgm::parse_errc::bad_value);
+    EXPECT_EQ(err.token, pgm::parse_error::npos);
+    EXPECT_EQ(err.text, "four");
+}
+
+TEST_F(env_0, invalid)
+{
+    args.env("-v", "TEST_ARGS_VERBOSE");
+    EXPECT_THROW(args.env("-q", "TEST_ARGS_VERBOSE"), pgm::invalid_definition);
+    EXPECT_THROW(args.env("--foo", "TEST_ARGS_FOO"), pgm::invalid_definition);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct config_0 : testing::Test
+{
+    pgm::args args
+    {
+        { "-v", "--verbose", "" },
+        { "-q", "--quiet", "" },
+        { "-j", "--jobs", "N", "" },
+        { "-I", "--include", "DIR", pgm::mul, "" },
+        {       "--name", "NAME", "" },
+        {       "--color", "WHEN", pgm::optval, "" },
+    };
+
+    std::string path = testing::TempDir() + "test_args.conf";
+
+    void write(std::string_view text) { std::ofstream{path, std::ios::binary} << text; }
+    void TearDown() override { std::remove(path.data()); }
+};
+
+TEST_F(config_0, parse)
+{
+    write("# comment\n"
+          "verbose\n"
+          "quiet = false\n"
+          "  jobs=4  \r\n"
+          "\n"
+          "; another comment\n"
+          "include = /usr/include\n"
+          "include = \"/opt/my include\"\n"
+          "name = foo\n"
+          "color\n");
+
+    EXPECT_NO_THROW({ args.parse_config(path); });
+    EXPECT_TRUE(args["-v"]);
+    EXPECT_FALSE(args["-q"]);
+    EXPECT_EQ(args["-j"].value(), "4");
+    EXPECT_EQ(args["-I"].values(), (std::pmr::vector<pgm::value_view>{"/usr/include", "/opt/my include"}));
+    EXPECT_EQ(args["--color"].value(), "");
+
+    // command line takes precedence
+    EXPECT_NO_THROW({ args.parse("-j 8 -I inc --name=bar --color=always"); });
+    EXPECT_EQ(args["-j"].value(), "8");
+    EXPECT_EQ(args["-I"].values(), (std::pmr::vector<pgm::value_view>{"inc"}));
+    EXPECT_EQ(args["--name"].value(), "bar");
+    EXPECT_EQ(args["--color"].value(), "always");
+    EXPECT_TRUE(args["-v"]);
+
+    // values set on the command line are kept
+    EXPECT_NO_THROW({ args.parse_config(path); });
+    EXPECT_EQ(args["-j"].value(), "8");
+}
+
+TEST_F(config_0, env)
+{
+    write("jobs = 4\nname = foo\n");
+    ::setenv("TEST_ARGS_JOBS", "6", 1);
+    args.env("--jobs", "TEST_ARGS_JOBS");
+
+    EXPECT_NO_THROW({ args.parse_config(path); });
+    EXPECT_NO_THROW({ args.parse(""); });
+    EXPECT_EQ(args["-j"].value(), "6");
+    EXPECT_EQ(args["--name"].value(), "foo");
+    ::unsetenv("TEST_ARGS_JOBS");
+}
+
+TEST_F(config_0, fifo)
+{
+    auto fifo = testing::TempDir() + "test_args.fifo";
+    std::remove(fifo.data());
+    ASSERT_EQ(::mkfifo(fifo.data(), 0600), 0);
+
+    std::thread writer{[&]{ std::ofstream{fifo, std::ios::binary} << "verbose\njobs = 4\n"; }};
+    EXPECT_NO_THROW({ args.parse_config(fifo); });
+    writer.join();
+    std::remove(fifo.data());
+
+    EXPECT_TRUE(args["-v"]);
+    EXPECT_EQ(args["-j"].value(), "4");
+}
+
+TEST_F(config_0, errors)
+{
+    write("verbose\njobs = 1\njobs = 2\n");
+    auto err = args.try_parse_config(path);
+    EXPECT_EQ(err.kind, pgm::parse_errc::duplicate_option);
+    EXPECT_EQ(err.token, 2);
+
+    auto errc = [&](std::string_view text){
+        write(text);
+        pgm::parse_result res;
+        return args.try_parse_config(path, res).kind;
+    };
+    EXPECT_EQ(errc("foo = bar"), pgm::parse_errc::unrecognized_option);
+    EXPECT_EQ(errc("[section]"), pgm::parse_errc::bad_config_line);
+    EXPECT_EQ(errc("= value"), pgm::parse_errc::bad_config_line);
+    EXPECT_EQ(errc("name"), pgm::parse_errc::missing_value);
+    EXPECT_EQ(errc("verbose = maybe"), pgm::parse_errc::bad_value);
+
+    // options are named by their canonical name, with file and line
+    auto msg = [&](std::string_view text){
+        write(text);
+        pgm::parse_result res;
+        return args.try_parse_config(path, res).message();
+    };
+    auto at = [&](int line){ return " in config file '" + path + "', line " + std::to_string(line) + "."; };
+    EXPECT_EQ(msg("j = 1\nj = 2"), "Invalid argument: unrecognized option 'j'" + at(1));
+    EXPECT_EQ(msg("jobs = 1\n\njobs = 2"), "Invalid argument: duplicate option '--jobs'" + at(3));
+    EXPECT_EQ(msg("name"), "Missing argument: '--name' requires a value" + at(1));
+    EXPECT_EQ(msg("verbose = maybe"), "Invalid argument: bad value 'maybe' for '--verbose'" + at(1));
+    EXPECT_EQ(msg("[section]"), "Invalid argument: bad line '[section]'" + at(1));
+
+    write("# jobs\njobs\n");
+    try { args.parse_config(path); FAIL(); }
+    catch (pgm::missing_argument& e) { EXPECT_EQ(e.what(), "Missing argument: '--jobs' requires a value" + at(2)); }
+
+    EXPECT_THROW(args.parse_config(path + ".none"), pgm::invalid_argument);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct abbrev_0 : testing::Test
+{
+    pgm::args args
+    {
+        { "-r", "--recursive", "" },
+        {       "--remove", "" },
+        {       "--color", "WHEN", "" },
+        {       "--colors", "" },
+        { "-v", "--verbose", "" },
+    };
+};
+
+TEST_F(abbrev_0, complete)
+{
+    auto names = args.complete("--re");
+    EXPECT_EQ(names.size(), 2);
+    EXPECT_EQ(std::vector<std::string_view>(names.begin(), names.end()),
+        (std::vector<std::string_view>{"--recursive", "--remove"})
+    );
+
+    EXPECT_EQ(args.complete("--").size(), 5);
+    EXPECT_EQ(*args.complete("--").begin(), "--color");
+    EXPECT_EQ(args.complete("--colo").size(), 2);
+    EXPECT_TRUE(args.complete("--x").empty());
+
+    args.add("--aaa", "");
+    EXPECT_EQ(*args.complete("--").begin(), "--aaa");
+}
+
+TEST_F(abbrev_0, parse)
+{
+    EXPECT_EQ(args.try_parse("--recur").kind, pgm::parse_errc::unrecognized_option);
+
+    args.abbreviations();
+    args.reset();
+    EXPECT_NO_THROW({ args.parse("--recur --verb --color=auto"); });
+    EXPECT_TRUE(args["-r"]);
+    EXPECT_TRUE(args["-v"]);
+    EXPECT_EQ(args["--color"].value(), "auto");
+    EXPECT_FALSE(args["--colors"]);
+
+    args.reset();
+    auto err = args.try_parse("--re");
+    EXPECT_EQ(err.kind, pgm::parse_errc::ambiguous_option);
+    EXPECT_EQ(err.message(), "Invalid argument: option '--re' is ambiguous.");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct complete_0 : testing::Test
+{
+    int made = 0;
+    pgm::args args
+    {
+        { "-v", "--verbose", "" },
+        { "-C", "DIR", pgm::req, "" },
+    };
+
+    void SetUp() override
+    {
+        args.add_command("clone", "", [&]{
+            ++made;
+            return pgm::args{ { "-b", "--branch", "NAME", "" }, { "-q", "--quiet", "" }, { "REPO", "" } };
+        });
+        args.add_command("commit", "", [&]{ ++made; return pgm::args{ }; });
+    }
+
+    std::string query(argcv p)
+    {
+        std::ostringstream os;
+        EXPECT_TRUE(args.complete(p.argc(), p.argv(), os));
+        return os.str();
+    }
+};
+
+TEST_F(complete_0, query)
+{
+    EXPECT_EQ(query({"pgm", "--complete", "c"}), "clone\ncommit\n");
+    EXPECT_EQ(query({"pgm", "--complete", "-"}), "-v\n-C\n--verbose\n");
+    EXPECT_EQ(query({"pgm", "--complete", "-C", ""}), ""); // option value
+    EXPECT_EQ(made, 0);
+
+    EXPECT_EQ(query({"pgm", "--complete", "-C", "dir", "clone", "--"}), "--branch\n--quiet\n");
+    EXPECT_EQ(query({"pgm", "--complete", "clone", "-qb", ""}), "");
+    EXPECT_EQ(query({"pgm", "--complete", "clone", "-bmain", "-"}), "-b\n-q\n--branch\n--quiet\n");
+    EXPECT_EQ(made, 3);
+
+    EXPECT_EQ(query({"pgm", "--complete", "push", "-"}), "");
+
+    std::ostringstream os;
+    auto p = argcv{"pgm", "-v"};
+    EXPECT_FALSE(args.complete(p.argc(), p.argv(), os));
+}
+
+TEST(complete_1, script)
+{
+    pgm::args args
+    {
+        { "-v", "--verbose", "" },
+        { "-o", "--output", "FILE", "" },
+        {       "--color", "WHEN", pgm::optval, "" },
+    };
+
+    std::ostringstream os;
+    args.completion_script(os, "my-prog");
+
+    auto text = os.str();
+    EXPECT_NE(text.find("_my_prog()\n"), text.npos);
+    EXPECT_NE(text.find("case $prev in -o|--output) return;; esac"), text.npos);
+    EXPECT_NE(text.find("compgen -W \"-v --verbose -o --output --color\""), text.npos);
+    EXPECT_NE(text.find("complete -o default -F _my_prog my-prog\n"), text.npos);
+    EXPECT_EQ(text.find("--complete"), text.npos);
+
+    os.str({ });
+    args.add_command("run", "", nullptr);
+    args.completion_script(os, "my-prog", pgm::shell::zsh);
+
+    text = os.str();
+    EXPECT_EQ(text.find("#compdef my-prog\n"), 0);
+    EXPECT_NE(text.find("--complete"), text.npos);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(choices_0, parse)
+{
+    enum color { never, always, automatic };
+
+    pgm::args args
+    {
+        {       "--color", "WHEN", pgm::optval, "" },
+        {       "--info", "FLAGS", pgm::mul, "" },
+        { "-v", "--verbose", "" },
+    };
+    args.choices("--color", { "never", "always", "auto" });
+    args.flag_set("--info", { "copy", "del", "name" });
+
+    EXPECT_THROW(args.choices("--foo", { "a" }), pgm::invalid_definition);
+    EXPECT_THROW(args.choices("-v", { "a" }), pgm::invalid_definition);
+    EXPECT_THROW(args.choices("--color", { "a", "a" }), pgm::invalid_definition);
+    EXPECT_THROW(args.flag_set("--info", { "a,b" }), pgm::invalid_definition);
+
+    EXPECT_NO_THROW({ args.parse("--color=auto --info=copy,name --info del"); });
+    EXPECT_EQ(args["--color"].value(), "auto");
+    EXPECT_EQ(args["--color"].choice<color>(), automatic);
+    EXPECT_EQ(args["--info"].choice(0), 0b101);
+    EXPECT_EQ(args["--info"].choice(1), 0b010);
+
+    args.reset();
+    EXPECT_NO_THROW({ args.parse("--color"); });
+    EXPECT_EQ(args["--color"].choice(), std::size_t(-1));
+
+    args.reset();
+    auto err = args.try_parse("--color=sometimes");
+    EXPECT_EQ(err.kind, pgm::parse_errc::bad_value);
+    EXPECT_EQ(err.message(), "Invalid argument: bad value 'sometimes' for '--color'.");
+
+    args.reset();
+    EXPECT_EQ(args.try_parse("--info=copy,mv").kind, pgm::parse_errc::bad_value);
+}
+
+TEST(separator_0, parse)
+{
+    pgm::args args
+    {
+        {       "--ids", "N", pgm::mul, "" },
+        {       "--info", "FLAGS", "" },
+        { "-v", "--verbose", "" },
+    };
+    args.separator("--ids", ',');
+    args.separator("--info", ':');
+    args.choices("--info", { "copy", "del" });
+
+    EXPECT_THROW(args.separator("--foo", ','), pgm::invalid_definition);
+    EXPECT_THROW(args.separator("-v", ','), pgm::invalid_definition);
+
+    EXPECT_NO_THROW({ args.parse("--ids=1,2,,3 --ids 4 --info=del:copy"); });
+    EXPECT_EQ(args["--ids"].count(), 5);
+    EXPECT_EQ(args["--ids"].values(), (std::pmr::vector<pgm::value_view>{"1", "2", "", "3", "4"}));
+    EXPECT_EQ(args["--info"].choice(0), 1);
+    EXPECT_EQ(args["--info"].choice(1), 0);
+
+    args.reset();
+    EXPECT_NO_THROW({ args.parse("--ids=10,20,30"); });
+    EXPECT_EQ(args["--ids"].values_as<int>(), (std::vector<int>{10, 20, 30}));
+
+    args.reset();
+    EXPECT_EQ(args.try_parse("--info=copy:mv").kind, pgm::parse_errc::bad_value);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(bulk_0, add)
+{
+    std::vector<pgm::arg> defs;
+    for (auto n = 0; n < 2000; ++n) defs.emplace_back("--flag-" + std::to_string(n), "");
+    defs.emplace_back("-x", "--extra", "N", "");
+    defs.emplace_back("files", pgm::mul, "");
+
+    pgm::args args{ { "-v", "--verbose", "" } };
+    args.reserve(defs.size());
+    args.add(defs);
+
+    EXPECT_EQ(args.complete("--flag-1999").size(), 1);
+    EXPECT_EQ(*args.complete("--").begin(), "--extra");
+
+    auto p = argcv{"pgm", "--flag-42", "-x", "7", "-v", "a", "b"};
+    EXPECT_NO_THROW({ args.parse(p.argc(), p.argv()); });
+    EXPECT_TRUE(args["--flag-42"]);
+    EXPECT_EQ(args["-x"].as<int>(), 7);
+    EXPECT_TRUE(args["--verbose"]);
+    EXPECT_EQ(args["files"].count(), 2);
+}
+
+TEST(bulk_0, errors)
+{
+    pgm::args args{ { "-v", "--verbose", "" }, { "files", pgm::mul, "" } };
+
+    auto error = [&](std::vector<pgm::arg> defs) -> std::string
+    {
+        try { args.add(defs); }
+        catch (std::exception const& e) { return e.what(); }
+        return { };
+    };
+
+    EXPECT_EQ(error({ { "-a", "" }, { "--verbose", "" } }), "Invalid definition: duplicate option '--verbose'.");
+    EXPECT_EQ(error({ { "-a", "" }, { "-b", "--bravo", "" }, { "-a", "--alpha", "" } }), "Invalid definition: duplicate option '-a'.");
+    EXPECT_EQ(error({ { "--bravo", "" }, { "-a", "" }, { "-b", "--bravo", "" } }), "Invalid definition: duplicate option '--bravo'.");
+    EXPECT_EQ(error({ { "p1", "" }, { "p1", pgm::opt, "" } }), "Invalid definition: duplicate param 'p1'.");
+    EXPECT_EQ(error({ { "more", pgm::mul, "" } }), "Invalid argument: more than one multi-value param 'more'.");
+
+    // nothing was added
+    EXPECT_THROW(args["-a"], pgm::invalid_argument);
+    EXPECT_THROW(args["p1"], pgm::invalid_argument);
+    EXPECT_EQ(args.complete("--").size(), 1);
+
+    // environment variables derived from env_prefix()
+    args.env_prefix("APP_");
+    args.add("--aa", "");
+    args.env("--aa", "APP_BB");
+    EXPECT_EQ(error({ { "--cc", "" }, { "--bb", "" } }), "Invalid definition: duplicate environment variable 'APP_BB'.");
+    EXPECT_EQ(error({ { "--dd", "" }, { "--DD", "" } }), "Invalid definition: duplicate environment variable 'APP_DD'.");
+    EXPECT_THROW(args.add("--bb", ""), pgm::invalid_definition);
+
+    EXPECT_THROW(args["--bb"], pgm::invalid_argument);
+    EXPECT_THROW(args["--cc"], pgm::invalid_argument);
+    EXPECT_EQ(args.complete("--").size(), 2);
+
+    args.add(std::vector<pgm::arg>{ { "--cc", "" }, { "--dd", "" } });
+    EXPECT_EQ(args.complete("--").size(), 4);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(parallel_0, convert)
+{
+    pgm::args args
+    {
+        {       "--ids", "N", "" },
+        { "-v", "--verbose", "" },
+        { "SRC", pgm::mul, "" },
+    };
+    args.separator("--ids", ',');
+    args.parallel("SRC", 100);
+    args.parallel("--ids", 100);
+
+    EXPECT_THROW(args.parallel("-v"), pgm::invalid_definition);
+    EXPECT_THROW(args.parallel("DST"), pgm::invalid_definition);
+
+    std::vector<std::string> words{"pgm"};
+    for (auto n = 0; n < 10000; ++n) words.push_back(std::to_string(n));
+
+    std::string ids;
+    for (auto n = 0; n < 5000; ++n) ids += (n ? "," : "--ids=") + std::to_string(n * 2);
+    words.push_back(ids);
+
+    std::vector<char*> argv;
+    for (auto& w : words) argv.push_back(w.data());
+
+    EXPECT_NO_THROW({ args.parse(static_cast<int>(argv.size()), argv.data()); });
+
+    auto& src = args["SRC"].values_as<int>();
+    ASSERT_EQ(src.size(), 10000);
+    for (auto n = 0; n < 10000; ++n) EXPECT_EQ(src[n], n);
+
+    auto& dst = args["--ids"].values_as<long>();
+    ASSERT_EQ(dst.size(), 5000);
+    EXPECT_EQ(dst[4999], 9998);
+
+    // first bad value is reported
+    words[1201] = "x"; words[1202] = "y"; words[9000] = "z"; words[7000] = "99999999999";
+    argv.clear();
+    for (auto& w : words) argv.push_back(w.data());
+
+    args.reset();
+    EXPECT_NO_THROW({ args.parse(static_cast<int>(argv.size()), argv.data()); });
+    try
+    {
+        args["SRC"].values_as<int>();
+        FAIL();
+    }
+    catch (pgm::invalid_argument const& e) { EXPECT_STREQ(e.what(), "Invalid argument: bad value 'x' for 'SRC'."); }
+
+    EXPECT_THROW(args["SRC"].values_as<short>(), pgm::invalid_argument);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(to_argv_0, serialize)
+{
+    pgm::args args
+    {
+        { "-v", "--verbose", pgm::mul, "" },
+        { "-o", "--output", "FILE", "" },
+        {       "--color", "WHEN", pgm::optval, "" },
+        { "-I", "DIR", pgm::mul, "" },
+        { "-j", "N", pgm::optval, "" },
+        {       "--ids", "N", "" },
+        {       "--secret", "TOKEN", "" },
+        { "SRC", pgm::mul, "" },
+        { "DST", "" },
+    };
+    args.separator("--ids", ',');
+
+    args.parse("-vv --color -I inc -I '' -j -o out --ids=1,2 --secret=xyz a -- -b c");
+
+    auto argv = args.to_argv("worker", [](std::string_view name){ return name != "--secret"; });
+    std::vector<std::string> got(argv.argv(), argv.argv() + argv.argc());
+    EXPECT_EQ(got, (std::vector<std::string>{
+        "worker", "--verbose", "--verbose", "--output=out", "--color=", "-Iinc", "-I", "", "-j", "--ids=1,2",
+        "--", "a", "-b", "c"
+    }));
+    EXPECT_EQ(argv.argv()[argv.argc()], nullptr);
+    EXPECT_EQ(argv[0], "worker");
+
+    // argv is contiguous
+    EXPECT_EQ(argv.argv()[1], argv.argv()[0] + 7);
+
+    // and survives copying
+    auto copy = argv;
+    argv = { };
+    EXPECT_EQ(std::vector<std::string>(copy.argv(), copy.argv() + copy.argc()), got);
+
+    // parses back the same
+    pgm::args again = args;
+    again.reset();
+    EXPECT_NO_THROW({ again.parse(copy.argv() + 1, copy.argv() + copy.argc()); });
+    EXPECT_EQ(again["-v"].count(), 2);
+    EXPECT_EQ(again["--color"].values(), (std::pmr::vector<pgm::value_view>{""}));
+    EXPECT_EQ(again["-j"].values(), (std::pmr::vector<pgm::value_view>{""}));
+    EXPECT_EQ(again["-I"].values(), (std::pmr::vector<pgm::value_view>{"inc", ""}));
+    EXPECT_EQ(again["--ids"].values(), (std::pmr::vector<pgm::value_view>{"1", "2"}));
+    EXPECT_FALSE(again["--secret"]);
+    EXPECT_EQ(again["SRC"].values(), (std::pmr::vector<pgm::value_view>{"a", "-b"}));
+    EXPECT_EQ(again["DST"].value(), "c");
+}
+
+TEST(to_argv_0, optval)
+{
+    pgm::args const args
+    {
+        {       "--opt", "VAL", pgm::optval, "" },
+        { "-o", "VAL", pgm::optval, "" },
+        { "-a", "" },
+        { "P", pgm::opt | pgm::mul, "" },
+    };
+
+    // empty optional values don't swallow params that follow them
+    auto round_trip = [&](std::string_view cmdline, std::vector<std::string_view> expected)
+    {
+        pgm::parse_result res, again;
+        args.parse(cmdline, res);
+
+        pgm::argv_buffer out;
+        args.to_argv(out, res, "p", [](std::string_view){ return true; });
+        EXPECT_EQ(std::vector<std::string_view>(out.argv(), out.argv() + out.argc()), expected);
+
+        args.parse(out.argv() + 1, out.argv() + out.argc(), again);
+        EXPECT_EQ(again["--opt"].values(), res["--opt"].values());
+        EXPECT_EQ(again["-o"].values(), res["-o"].values());
+        EXPECT_EQ(again["P"].values(), res["P"].values());
+    };
+
+    round_trip("--opt -a z", {"p", "--opt=", "-a", "z"});
+    round_trip("-o -a z", {"p", "-o", "-a", "--", "z"});
+    round_trip("-o x -a z", {"p", "-ox", "-a", "z"});
+    round_trip("-o", {"p", "-o"});
+}
+
+TEST(to_argv_0, command)
+{
+    pgm::args args{ { "-C", "DIR", "" } };
+    args.add_command("clone", "", []{ return pgm::args{ { "-b", "--branch", "NAME", "" }, { "REPO", "" } }; });
+
+    args.parse("-C dir clone -b main repo");
+
+    pgm::argv_buffer out;
+    args.to_argv(out, "git", [](std::string_view){ return true; });
+    EXPECT_EQ(std::vector<std::string_view>(out.argv(), out.argv() + out.argc()),
+        (std::vector<std::string_view>{"git", "-Cdir", "clone", "--branch=main", "repo"})
+    );
+
+    args.to_argv(out, "git", [](std::string_view name){ return name != "-C"; });
+    EXPECT_EQ(out.size(), 4);
+
+    // "--" before the subcommand, which would be taken as the value otherwise
+    pgm::args opt{ { "-c", "WHEN", pgm::optval, "" } };
+    opt.add_command("clone", "", []{ return pgm::args{ { "REPO", "" } }; });
+
+    pgm::parse_result res;
+    opt.parse("-c -- clone repo", res);
+    opt.to_argv(out, res, "git", [](std::string_view){ return true; });
+    EXPECT_EQ(std::vector<std::string_view>(out.argv(), out.argv() + out.argc()),
+        (std::vector<std::string_view>{"git", "-c", "--", "clone", "repo"})
+    );
+
+    pgm::parse_result again;
+    opt.parse(out.argv() + 1, out.argv() + out.argc(), again);
+    EXPECT_EQ(again["-c"].value(), "");
+    EXPECT_EQ(again.command(), "clone");
+}
@@ -0,0 +1,38 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "pgm/args.hpp"
+
+#include <gtest/gtest.h>
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(stats, parse)
+{
+    pgm::args args
+    {
+        { "-a", "" },
+        { "-b", "" },
+        { "-o", "--output", "FILE", "" },
+        {       "--ids", "N", "" },
+        { "p1", "" },
+        { "p2", pgm::opt, "" },
+    };
+    args.separator("--ids", ',');
+
+    EXPECT_NO_THROW({ args.parse("-ab -o 'my file' --ids=1,2,3 foo bar"); });
+
+    auto& stats = args.stats();
+    EXPECT_EQ(stats.tokens, 6);
+    EXPECT_EQ(stats.options, 4);
+    EXPECT_EQ(stats.params, 2);
+    EXPECT_EQ(stats.short_groups, 1);
+    EXPECT_EQ(stats.values, 6);
+    EXPECT_EQ(stats.bytes, std::string{"'my file'"}.size());
+    EXPECT_GT(stats.match.count(), 0);
+
+    args.reset();
+    EXPECT_EQ(args.stats().tokens, 0);
+
+    EXPECT_NO_THROW({ args.parse("-a foo"); });
+    EXPECT_EQ(args.stats().tokens, 2);
+    EXPECT_EQ(args.stats().bytes, 0);
+}